@@ -3,7 +3,12 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "devices/timer.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
 
 /* A block device. */
 struct block
@@ -17,10 +22,37 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
+    struct block *parent;               /* Device partitioned, or null. */
+    block_sector_t start;               /* First sector within PARENT. */
+
     unsigned long long read_cnt;        /* Number of sectors read. */
     unsigned long long write_cnt;       /* Number of sectors written. */
+
+    /* Request queue, served by the device's dispatch thread.
+       Unused in partitions, whose requests go to PARENT's. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_cond;        /* Signaled when a request arrives. */
+    struct list sorted;                 /* Pending requests by sector. */
+    struct list fifo;                   /* Pending requests by arrival. */
+    block_sector_t head;                /* Sector after the last dispatched. */
+    void *merge_buffer;                 /* Staging for merged requests. */
   };
 
+/* Ticks a read or write request may wait before the elevator
+   serves it ahead of requests for nearer sectors. */
+#define READ_EXPIRE (TIMER_FREQ / 2)
+#define WRITE_EXPIRE (TIMER_FREQ * 5)
+
+/* Most sectors in a merged request, and the number of pages
+   needed to stage them. */
+#define MERGE_MAX 32
+#define MERGE_PAGES (MERGE_MAX * BLOCK_SECTOR_SIZE / PGSIZE)
+
+static thread_func dispatch_daemon NO_RETURN;
+static struct block *register_block (const char *name, enum block_type,
+                                     const char *extra_info,
+                                     block_sector_t size);
+
 /* List of all block devices. */
 static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 
@@ -114,6 +146,104 @@ check_sector (struct block *block, block_sector_t sector)
     }
 }
 
+/* Verifies that the CNT sectors starting at SECTOR lie within
+   BLOCK.  Panics if not. */
+static void
+check_sectors (struct block *block, block_sector_t sector, size_t cnt)
+{
+  ASSERT (cnt > 0);
+  check_sector (block, sector);
+  if (cnt > block->size - sector)
+    PANIC ("Access past end of device %s (sector=%"PRDSNu", cnt=%zu, "
+           "size=%"PRDSNu")\n", block_name (block), sector, cnt,
+           block->size);
+}
+
+/* Returns true if request A is for an earlier sector than
+   request B. */
+static bool
+request_less (const struct list_elem *a_, const struct list_elem *b_,
+              void *aux UNUSED)
+{
+  const struct block_request *a
+    = list_entry (a_, struct block_request, sort_elem);
+  const struct block_request *b
+    = list_entry (b_, struct block_request, sort_elem);
+
+  return a->sector < b->sector;
+}
+
+/* Queues REQUEST on BLOCK and returns without waiting for it.
+   When the transfer is done, REQUEST->done (if nonnull) is
+   called from BLOCK's dispatch thread with REQUEST as argument;
+   it should not block for long.  REQUEST must stay allocated
+   until then.
+
+   Pending requests are served in C-LOOK order, so they may
+   complete in a different order than they were submitted.
+   Callers must not submit overlapping requests without waiting
+   for the earlier one to complete.
+
+   A request for a partition is queued on the partitioned device,
+   with REQUEST->sector changed to the sector within it. */
+void
+block_submit (struct block *block, struct block_request *request)
+{
+  check_sectors (block, request->sector, request->cnt);
+  if (request->write)
+    {
+      ASSERT (block->type != BLOCK_FOREIGN);
+      block->write_cnt += request->cnt;
+    }
+  else
+    block->read_cnt += request->cnt;
+
+  if (block->parent != NULL)
+    {
+      request->sector += block->start;
+      block_submit (block->parent, request);
+      return;
+    }
+
+  request->deadline = timer_ticks () + (request->write
+                                        ? WRITE_EXPIRE : READ_EXPIRE);
+
+  lock_acquire (&block->queue_lock);
+  list_insert_ordered (&block->sorted, &request->sort_elem,
+                       request_less, NULL);
+  list_push_back (&block->fifo, &request->fifo_elem);
+  cond_signal (&block->queue_cond, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Completion function for requests made by do_request(). */
+static void
+wake_requester (struct block_request *request)
+{
+  sema_up (request->aux);
+}
+
+/* Transfers the CNT sectors starting at SECTOR between BLOCK and
+   BUFFER through BLOCK's request queue, writing if WRITE is true
+   and reading otherwise.  Returns when the transfer is done. */
+static void
+do_request (struct block *block, block_sector_t sector, size_t cnt,
+            void *buffer, bool write)
+{
+  struct block_request request;
+  struct semaphore done;
+
+  sema_init (&done, 0);
+  request.sector = sector;
+  request.cnt = cnt;
+  request.buffer = buffer;
+  request.write = write;
+  request.done = wake_requester;
+  request.aux = &done;
+  block_submit (block, &request);
+  sema_down (&done);
+}
+
 /* Reads sector SECTOR from BLOCK into BUFFER, which must
    have room for BLOCK_SECTOR_SIZE bytes.
 
@@ -122,9 +252,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  do_request (block, sector, 1, buffer, false);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -135,10 +263,186 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  do_request (block, sector, 1, (void *) buffer, true);
+}
+
+/* Reads the CNT consecutive sectors starting at SECTOR from
+   BLOCK into BUFFER, which must have room for
+   CNT * BLOCK_SECTOR_SIZE bytes.  Drivers that support it
+   transfer all of them with a single request.
+
+   Internally synchronizes accesses to block devices,
+   so external per-block device locking is unneeded. */
+void
+block_read_multi (struct block *block, block_sector_t sector, size_t cnt,
+                  void *buffer)
+{
+  do_request (block, sector, cnt, buffer, false);
+}
+
+/* Writes the CNT consecutive sectors starting at SECTOR to BLOCK
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.  Drivers that support it transfer all of them
+   with a single request.
+
+   Internally synchronizes accesses to block devices, so external
+   per-block device locking is unneeded. */
+void
+block_write_multi (struct block *block, block_sector_t sector, size_t cnt,
+                   const void *buffer)
+{
+  do_request (block, sector, cnt, (void *) buffer, true);
+}
+
+/* Has BLOCK's driver transfer the CNT sectors starting at SECTOR
+   between the device and BUFFER, writing if WRITE is true and
+   reading otherwise. */
+static void
+transfer (struct block *block, block_sector_t sector, size_t cnt,
+          void *buffer, bool write)
+{
+  const struct block_operations *ops = block->ops;
+  uint8_t *p = buffer;
+  size_t i;
+
+  if (cnt > 1 && write && ops->write_multi != NULL)
+    ops->write_multi (block->aux, sector, cnt, buffer);
+  else if (cnt > 1 && !write && ops->read_multi != NULL)
+    ops->read_multi (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++, p += BLOCK_SECTOR_SIZE)
+      {
+        if (write)
+          ops->write (block->aux, sector + i, p);
+        else
+          ops->read (block->aux, sector + i, p);
+      }
+}
+
+/* Chooses the next request for BLOCK to serve.  Normally this
+   is the pending request with the lowest sector at or after the
+   last one served, wrapping around to the lowest sector overall
+   when there is none (C-LOOK).  But a request that has waited
+   past its deadline is served first.  BLOCK's queue_lock must be
+   held and its queue must not be empty. */
+static struct block_request *
+pick_request (struct block *block)
+{
+  struct block_request *oldest;
+  struct list_elem *e;
+
+  oldest = list_entry (list_front (&block->fifo),
+                       struct block_request, fifo_elem);
+  if (timer_ticks () >= oldest->deadline)
+    return oldest;
+
+  for (e = list_begin (&block->sorted); e != list_end (&block->sorted);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request,
+                                            sort_elem);
+      if (r->sector >= block->head)
+        return r;
+    }
+  return list_entry (list_front (&block->sorted),
+                     struct block_request, sort_elem);
+}
+
+/* Removes REQUEST from its device's queue and appends it to
+   BATCH. */
+static void
+take_request (struct block_request *request, struct list *batch)
+{
+  list_remove (&request->sort_elem);
+  list_remove (&request->fifo_elem);
+  list_push_back (batch, &request->fifo_elem);
+}
+
+/* Dispatch thread for BLOCK_.  Takes requests off the device's
+   queue in elevator order, merging each with following requests
+   for adjacent sectors in the same direction, and passes them to
+   the driver one at a time. */
+static void
+dispatch_daemon (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct block_request *first;
+      struct list batch;
+      struct list_elem *e;
+      size_t cnt;
+
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->fifo))
+        cond_wait (&block->queue_cond, &block->queue_lock);
+
+      list_init (&batch);
+      first = pick_request (block);
+      cnt = first->cnt;
+      e = list_next (&first->sort_elem);
+      take_request (first, &batch);
+      while (e != list_end (&block->sorted))
+        {
+          struct block_request *r = list_entry (e, struct block_request,
+                                                sort_elem);
+          if (r->sector != first->sector + cnt || r->write != first->write
+              || cnt + r->cnt > MERGE_MAX)
+            break;
+          if (block->merge_buffer == NULL)
+            {
+              block->merge_buffer = palloc_get_multiple (0, MERGE_PAGES);
+              if (block->merge_buffer == NULL)
+                break;
+            }
+          e = list_next (e);
+          take_request (r, &batch);
+          cnt += r->cnt;
+        }
+      block->head = first->sector + cnt;
+      lock_release (&block->queue_lock);
+
+      if (list_size (&batch) == 1)
+        transfer (block, first->sector, cnt, first->buffer, first->write);
+      else
+        {
+          uint8_t *p;
+
+          if (first->write)
+            for (p = block->merge_buffer, e = list_begin (&batch);
+                 e != list_end (&batch); e = list_next (e))
+              {
+                struct block_request *r
+                  = list_entry (e, struct block_request, fifo_elem);
+                memcpy (p, r->buffer, r->cnt * BLOCK_SECTOR_SIZE);
+                p += r->cnt * BLOCK_SECTOR_SIZE;
+              }
+          transfer (block, first->sector, cnt, block->merge_buffer,
+                    first->write);
+          if (!first->write)
+            for (p = block->merge_buffer, e = list_begin (&batch);
+                 e != list_end (&batch); e = list_next (e))
+              {
+                struct block_request *r
+                  = list_entry (e, struct block_request, fifo_elem);
+                memcpy (r->buffer, p, r->cnt * BLOCK_SECTOR_SIZE);
+                p += r->cnt * BLOCK_SECTOR_SIZE;
+              }
+        }
+
+      /* A request may be freed as soon as its completion function
+         runs, so unlink it first. */
+      while (!list_empty (&batch))
+        {
+          struct block_request *r
+            = list_entry (list_pop_front (&batch),
+                          struct block_request, fifo_elem);
+          if (r->done != NULL)
+            r->done (r);
+        }
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -184,11 +488,48 @@ block_print_stats (void)
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
    be provided, as well as the it operation functions OPS, which
-   will be passed AUX in each function call. */
+   will be passed AUX in each function call.  The device gets a
+   dispatch thread of its own to serve its request queue. */
 struct block *
 block_register (const char *name, enum block_type type,
                 const char *extra_info, block_sector_t size,
                 const struct block_operations *ops, void *aux)
+{
+  struct block *block = register_block (name, type, extra_info, size);
+
+  block->ops = ops;
+  block->aux = aux;
+  thread_create (block->name, PRI_MAX, dispatch_daemon, block);
+
+  return block;
+}
+
+/* Registers a partition named NAME of block device PARENT, made
+   up of the SIZE sectors starting at sector START of PARENT,
+   with the given TYPE.  If EXTRA_INFO is non-null, it is printed
+   as part of a user message.  Requests for the partition are
+   served by PARENT's dispatch thread, in the same elevator order
+   as PARENT's own. */
+struct block *
+block_register_partition (const char *name, enum block_type type,
+                          const char *extra_info, struct block *parent,
+                          block_sector_t start, block_sector_t size)
+{
+  struct block *block = register_block (name, type, extra_info, size);
+
+  ASSERT (parent->parent == NULL);
+  block->parent = parent;
+  block->start = start;
+
+  return block;
+}
+
+/* Allocates and initializes a block device with the given NAME,
+   TYPE, and SIZE, adds it to all_blocks, and prints a message
+   about it including EXTRA_INFO if that is non-null. */
+static struct block *
+register_block (const char *name, enum block_type type,
+                const char *extra_info, block_sector_t size)
 {
   struct block *block = malloc (sizeof *block);
   if (block == NULL)
@@ -198,10 +539,18 @@ block_register (const char *name, enum block_type type,
   strlcpy (block->name, name, sizeof block->name);
   block->type = type;
   block->size = size;
-  block->ops = ops;
-  block->aux = aux;
+  block->ops = NULL;
+  block->aux = NULL;
+  block->parent = NULL;
+  block->start = 0;
   block->read_cnt = 0;
   block->write_cnt = 0;
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_cond);
+  list_init (&block->sorted);
+  list_init (&block->fifo);
+  block->head = 0;
+  block->merge_buffer = NULL;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
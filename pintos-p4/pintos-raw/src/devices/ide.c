@@ -8,10 +8,18 @@
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].
+
+   If the controller is a PCI bus master IDE controller, such as
+   the Intel PIIX emulated by QEMU and Bochs, and a disk supports
+   DMA, transfers to and from kernel memory use bus master DMA,
+   so that the CPU runs other threads while data moves.
+   Otherwise, and if a DMA transfer fails, we use PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -24,6 +32,12 @@
 #define reg_status(CHANNEL) ((CHANNEL)->reg_base + 7)   /* Status (r/o). */
 #define reg_command(CHANNEL) reg_status (CHANNEL)       /* Command (w/o). */
 
+/* Bus master IDE port addresses, relative to the channel's
+   bm_base. */
+#define reg_bm_command(CHANNEL) ((CHANNEL)->bm_base + 0) /* Command. */
+#define reg_bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)  /* Status. */
+#define reg_bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)    /* PRD table. */
+
 /* ATA control block port addresses.
    (If we supported non-legacy ATA controllers this would not be
    flexible enough, but it's fine for what we do.) */
@@ -34,10 +48,19 @@
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
 
+/* Bus Master Command Register bits. */
+#define BM_START 0x01           /* Start bus master transfer. */
+#define BM_READ 0x08            /* Transfer from disk to memory. */
+
+/* Bus Master Status Register bits. */
+#define BM_ERROR 0x02           /* Transfer failed (write 1 to clear). */
+#define BM_INTR 0x04            /* Disk interrupted (write 1 to clear). */
+
 /* Device Register bits. */
 #define DEV_MBS 0xa0            /* Must be set. */
 #define DEV_LBA 0x40            /* Linear based addressing. */
@@ -49,6 +72,15 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Most sectors a single READ or WRITE command can transfer.
+   A sector count of 0 in the Sector Count register means 256. */
+#define MAX_NSECT 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +89,26 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple;               /* Sectors per interrupt for READ/WRITE
+                                   MULTIPLE, or 0 if not supported. */
+    bool dma;                   /* Use bus master DMA? */
   };
 
+/* A physical region descriptor, which tells the bus master where
+   in physical memory one piece of a DMA transfer goes.  A PRD
+   table is an array of these, the last one marked with
+   PRD_EOT. */
+struct prd
+  {
+    uint32_t addr;              /* Physical address of region. */
+    uint16_t size;              /* Size in bytes, with 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT on the last entry. */
+  };
+
+#define PRD_EOT 0x8000          /* End of table. */
+#define PRD_BOUNDARY 0x10000    /* A region may not cross a multiple of
+                                   this. */
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -66,6 +116,8 @@ struct channel
     char name[8];               /* Name, e.g. "ide0". */
     uint16_t reg_base;          /* Base I/O port. */
     uint8_t irq;                /* Interrupt in use. */
+    uint16_t bm_base;           /* Bus master base I/O port, or 0. */
+    struct prd *prdt;           /* PRD table, if bm_base is nonzero. */
 
     struct lock lock;           /* Must acquire to access the controller. */
     bool expecting_interrupt;   /* True if an interrupt is expected, false if
@@ -84,8 +136,13 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, int sectors);
+static uint16_t probe_bus_master (void);
+
+static bool dma_transfer (struct ata_disk *, block_sector_t, size_t cnt,
+                          void *buffer, bool read);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -101,6 +158,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = probe_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +184,16 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+
+      /* Each channel has 8 bytes of bus master registers. */
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          c->prdt = palloc_get_page (0);
+          if (c->prdt != NULL)
+            c->bm_base = bm_base + chan_no * 8;
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +204,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -303,12 +373,113 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Word 47 bits 7:0 give the most sectors the disk can transfer
+     per interrupt with READ/WRITE MULTIPLE. */
+  set_multiple_mode (d, (uint8_t) id[47 * 2]);
+
+  /* Word 49 bit 8 says whether the disk supports DMA. */
+  d->dma = c->bm_base != 0 && (id[49 * 2 + 1] & 0x01) != 0;
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Enables READ/WRITE MULTIPLE on disk D with SECTORS sectors per
+   interrupt, using the largest power of 2 that is not more than
+   SECTORS.  Leaves D->multiple at 0 if SECTORS is 0 or the disk
+   rejects the command, in which case multi-sector transfers use
+   READ/WRITE SECTOR and take one interrupt per sector. */
+static void
+set_multiple_mode (struct ata_disk *d, int sectors)
+{
+  struct channel *c = d->channel;
+  int cnt;
+
+  d->multiple = 0;
+  if (sectors <= 0)
+    return;
+  for (cnt = 1; cnt * 2 <= sectors && cnt * 2 < MAX_NSECT; cnt *= 2)
+    continue;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if ((inb (reg_status (c)) & STA_ERR) == 0)
+    d->multiple = cnt;
+}
+
+/* PCI configuration space ports. */
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Returns the 32-bit PCI configuration register at byte offset
+   REG of function FUNC of device DEV on bus 0. */
+static uint32_t
+pci_read_config (int dev, int func, int reg)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Sets the 32-bit PCI configuration register at byte offset REG
+   of function FUNC of device DEV on bus 0 to DATA. */
+static void
+pci_write_config (int dev, int func, int reg, uint32_t data)
+{
+  outl (PCI_CONFIG_ADDR, 0x80000000 | (dev << 11) | (func << 8) | reg);
+  outl (PCI_CONFIG_DATA, data);
+}
+
+/* Looks on PCI bus 0 for an IDE controller that can act as bus
+   master, and enables bus mastering on it.  Returns the base I/O
+   port of its bus master registers, or 0 if there is no such
+   controller. */
+static uint16_t
+probe_bus_master (void)
+{
+  int dev, func;
+
+  for (dev = 0; dev < 32; dev++)
+    for (func = 0; func < 8; func++)
+      {
+        uint32_t id = pci_read_config (dev, func, 0x00);
+        uint32_t class, bar, command;
+
+        if ((id & 0xffff) == 0xffff)
+          {
+            /* No such function.  If function 0 is missing, the
+               whole device is. */
+            if (func == 0)
+              break;
+            continue;
+          }
+
+        /* Class 01h (mass storage), subclass 01h (IDE), with
+           programming interface bit 7 (bus master capable). */
+        class = pci_read_config (dev, func, 0x08);
+        if ((class >> 16) != 0x0101 || (class & 0x8000) == 0)
+          continue;
+
+        /* BAR 4 holds the bus master registers, in I/O space. */
+        bar = pci_read_config (dev, func, 0x20);
+        if ((bar & 1) == 0 || (bar & 0xfffc) == 0)
+          continue;
+
+        /* Enable I/O space decoding and bus mastering.  The upper
+           half of the register is status, whose bits are cleared
+           by writing 1s, so write 0s there. */
+        command = pci_read_config (dev, func, 0x04) & 0xffff;
+        pci_write_config (dev, func, 0x04, command | 0x05);
+
+        return bar & 0xfffc;
+      }
+  return 0;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -346,8 +517,10 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  if (dma_transfer (d, sec_no, 1, buffer, true))
+    return;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_READ_SECTOR_RETRY);
   sema_down (&c->completion_wait);
   if (!wait_while_busy (d))
@@ -366,8 +539,10 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
   struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  if (dma_transfer (d, sec_no, 1, (void *) buffer, false))
+    return;
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
+  select_sector (d, sec_no, 1);
   issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
   if (!wait_while_busy (d))
     PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -376,24 +551,208 @@ ide_write (void *d_, block_sector_t sec_no, const void *buffer)
   lock_release (&c->lock);
 }
 
+/* Reads the CNT sectors starting at SEC_NO from disk D into
+   BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE bytes.
+   Each command moves up to MAX_NSECT sectors.  With READ
+   MULTIPLE the disk interrupts once per D->multiple sectors
+   instead of once per sector.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read_multi (void *d_, block_sector_t sec_no, size_t cnt, void *buffer)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  uint8_t *p = buffer;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+
+  if (dma_transfer (d, sec_no, cnt, buffer, true))
+    return;
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      size_t nsect = cnt < MAX_NSECT ? cnt : MAX_NSECT;
+      size_t left;
+
+      select_sector (d, sec_no, nsect);
+      issue_pio_command (c, (d->multiple > 0
+                             ? CMD_READ_MULTIPLE
+                             : CMD_READ_SECTOR_RETRY));
+      for (left = nsect; left > 0; )
+        {
+          size_t n = left < per_intr ? left : per_intr;
+
+          sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                   d->name, sec_no + (nsect - left));
+          for (; n > 0; n--, left--, p += BLOCK_SECTOR_SIZE)
+            input_sector (c, p);
+        }
+      sec_no += nsect;
+      cnt -= nsect;
+    }
+  lock_release (&c->lock);
+}
+
+/* Writes the CNT sectors starting at SEC_NO to disk D from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving all of the
+   data.  Commands are split as in ide_read_multi().
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_write_multi (void *d_, block_sector_t sec_no, size_t cnt,
+                 const void *buffer)
+{
+  struct ata_disk *d = d_;
+  struct channel *c = d->channel;
+  const uint8_t *p = buffer;
+  size_t per_intr = d->multiple > 0 ? (size_t) d->multiple : 1;
+
+  if (dma_transfer (d, sec_no, cnt, (void *) buffer, false))
+    return;
+  lock_acquire (&c->lock);
+  while (cnt > 0)
+    {
+      size_t nsect = cnt < MAX_NSECT ? cnt : MAX_NSECT;
+      size_t left;
+
+      select_sector (d, sec_no, nsect);
+      issue_pio_command (c, (d->multiple > 0
+                             ? CMD_WRITE_MULTIPLE
+                             : CMD_WRITE_SECTOR_RETRY));
+
+      /* The disk asks for the first block of data right away and
+         for each later one with an interrupt.  A final interrupt
+         follows the last block. */
+      for (left = nsect; left > 0; )
+        {
+          size_t n = left < per_intr ? left : per_intr;
+
+          if (left != nsect)
+            sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                   d->name, sec_no + (nsect - left));
+          for (; n > 0; n--, left--, p += BLOCK_SECTOR_SIZE)
+            output_sector (c, p);
+        }
+      sema_down (&c->completion_wait);
+      sec_no += nsect;
+      cnt -= nsect;
+    }
+  lock_release (&c->lock);
+}
+
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multi,
+    ide_write_multi
   };
+
+/* Fills in channel C's PRD table to describe the SIZE bytes at
+   BUFFER.  Kernel virtual memory maps physical memory one to
+   one, so BUFFER is physically contiguous and only needs to be
+   split at PRD_BOUNDARY. */
+static void
+build_prdt (struct channel *c, void *buffer, size_t size)
+{
+  struct prd *prd = c->prdt;
+  uintptr_t phys = vtop (buffer);
+
+  ASSERT (size > 0);
+
+  while (size > 0)
+    {
+      size_t n = PRD_BOUNDARY - phys % PRD_BOUNDARY;
+      if (n > size)
+        n = size;
+
+      prd->addr = phys;
+      prd->size = n % PRD_BOUNDARY;
+      prd->flags = 0;
+      prd++;
+
+      phys += n;
+      size -= n;
+    }
+  prd[-1].flags = PRD_EOT;
+}
+
+/* Transfers the CNT sectors starting at SEC_NO between disk D
+   and BUFFER with bus master DMA, reading from the disk if READ
+   is true and writing to it otherwise.  The calling thread
+   sleeps until each command completes.
+
+   Returns false without transferring anything if DMA cannot be
+   used, that is, if D or its controller does not support it or
+   BUFFER is not in kernel memory.  Also returns false if the
+   transfer fails, after turning off DMA for D.  Either way the
+   caller should then use PIO. */
+static bool
+dma_transfer (struct ata_disk *d, block_sector_t sec_no, size_t cnt,
+              void *buffer, bool read)
+{
+  struct channel *c = d->channel;
+  uint8_t direction = read ? BM_READ : 0;
+  uint8_t *p = buffer;
+  bool ok = true;
+
+  if (!d->dma || !is_kernel_vaddr (buffer))
+    return false;
+
+  lock_acquire (&c->lock);
+  while (ok && cnt > 0)
+    {
+      size_t nsect = cnt < MAX_NSECT ? cnt : MAX_NSECT;
+      uint8_t bm_status;
+
+      build_prdt (c, p, nsect * BLOCK_SECTOR_SIZE);
+      outl (reg_bm_prdt (c), vtop (c->prdt));
+      outb (reg_bm_command (c), direction);
+      outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+
+      select_sector (d, sec_no, nsect);
+      issue_pio_command (c, read ? CMD_READ_DMA : CMD_WRITE_DMA);
+      outb (reg_bm_command (c), direction | BM_START);
+      sema_down (&c->completion_wait);
+      outb (reg_bm_command (c), direction);
+
+      bm_status = inb (reg_bm_status (c));
+      outb (reg_bm_status (c), BM_ERROR | BM_INTR);
+      ok = ((bm_status & BM_ERROR) == 0
+            && (inb (reg_alt_status (c)) & STA_ERR) == 0);
+
+      p += nsect * BLOCK_SECTOR_SIZE;
+      sec_no += nsect;
+      cnt -= nsect;
+    }
+  lock_release (&c->lock);
+
+  if (!ok)
+    {
+      printf ("%s: DMA transfer failed, using PIO\n", d->name);
+      d->dma = false;
+    }
+  return ok;
+}
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT to the disk's sector
+   selection registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
-  ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt > 0 && cnt <= MAX_NSECT);
+  ASSERT (sec_no < (1UL << 28) && cnt <= (1UL << 28) - sec_no);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_NSECT ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -0,0 +1,562 @@
+#include "filesys/cache.h"
+#include <debug.h>
+#include <stdbool.h>
+#include <string.h>
+#include "devices/timer.h"
+#include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-back buffer cache for the file system device.
+
+   All file system sector I/O goes through the CACHE_CNT entries
+   below.  Writes only mark an entry dirty; dirty entries reach
+   the disk when they are evicted or when cache_flush() runs.
+   Eviction uses the clock algorithm.
+
+   Sectors passed to cache_readahead() are loaded in the
+   background by a kernel thread, so that sequential readers
+   find them already cached.
+
+   A second kernel thread writes dirty sectors back every
+   cache_flush_ms milliseconds, and sooner if evictions start
+   having to write back dirty sectors themselves.
+
+   Both threads move runs of consecutive sectors to and from the
+   disk with a single multi-sector request, staged through
+   io_buffer.
+
+   Metadata written with cache_write_meta() is pinned until the
+   journal has committed it: pinned entries are neither evicted
+   nor flushed. */
+
+/* Number of sectors held in the cache. */
+#define CACHE_CNT 64
+
+/* A cached sector. */
+struct cache_entry
+  {
+    /* Protected by cache_lock.  Changing SECTOR or IN_USE also
+       requires LOCK, so a thread holding LOCK may read them. */
+    block_sector_t sector;              /* Cached sector, if IN_USE. */
+    bool in_use;                        /* Does this entry hold a sector? */
+    bool accessed;                      /* Used since the clock hand passed? */
+
+    /* Protected by LOCK. */
+    struct lock lock;                   /* Held while using the data. */
+    bool dirty;                         /* Modified since last written? */
+    bool pinned;                        /* Waiting for a journal commit? */
+    uint8_t data[BLOCK_SECTOR_SIZE];    /* Sector contents. */
+  };
+
+static struct cache_entry cache[CACHE_CNT];
+
+/* Protects the sector-to-entry mapping and the clock hand.
+   assign_entry() acquires it while holding an entry's lock, so
+   nobody may wait for an entry's lock while holding it. */
+static struct lock cache_lock;
+
+/* Next entry the clock algorithm will consider for eviction. */
+static size_t clock_hand;
+
+/* Maximum number of pending read-ahead requests.
+   Requests beyond this are dropped. */
+#define READAHEAD_CNT 32
+
+/* Ring buffer of sectors waiting to be read ahead. */
+static block_sector_t readahead_queue[READAHEAD_CNT];
+static size_t readahead_head;           /* Index of oldest request. */
+static size_t readahead_cnt;            /* Number of requests queued. */
+static struct lock readahead_lock;      /* Protects the queue. */
+static struct condition readahead_cond; /* Signaled when queue nonempty. */
+
+static thread_func readahead_daemon NO_RETURN;
+
+/* Most sectors moved by one multi-sector request. */
+#define RUN_MAX 16
+
+/* Staging buffer for multi-sector requests.  io_lock must be
+   acquired before cache_lock or any entry's lock. */
+static uint8_t io_buffer[RUN_MAX * BLOCK_SECTOR_SIZE];
+static struct lock io_lock;
+
+/* Milliseconds between write-behind flushes, or 0 to flush only
+   when evictions find dirty sectors.  Set by the kernel
+   command-line option "-flush=MS". */
+unsigned cache_flush_ms = 5000;
+
+/* Upped when the flush thread should run: by an eviction that
+   had to write back a dirty sector, and every cache_flush_ms
+   milliseconds by the flush timer thread. */
+static struct semaphore flush_sema;
+
+static thread_func flush_daemon NO_RETURN;
+static thread_func flush_timer NO_RETURN;
+
+/* Initializes the buffer cache. */
+void
+cache_init (void)
+{
+  size_t i;
+
+  lock_init (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      e->in_use = false;
+      e->accessed = false;
+      e->dirty = false;
+      e->pinned = false;
+      lock_init (&e->lock);
+    }
+  clock_hand = 0;
+  lock_init (&io_lock);
+
+  lock_init (&readahead_lock);
+  cond_init (&readahead_cond);
+  readahead_head = readahead_cnt = 0;
+  thread_create ("readahead", PRI_DEFAULT, readahead_daemon, NULL);
+
+  sema_init (&flush_sema, 0);
+  thread_create ("flush", PRI_DEFAULT, flush_daemon, NULL);
+  if (cache_flush_ms > 0)
+    thread_create ("flush-timer", PRI_DEFAULT, flush_timer, NULL);
+}
+
+/* Returns the entry holding SECTOR, or a null pointer if SECTOR
+   is not cached.  cache_lock must be held. */
+static struct cache_entry *
+lookup (block_sector_t sector)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < CACHE_CNT; i++)
+    if (cache[i].in_use && cache[i].sector == sector)
+      return &cache[i];
+  return NULL;
+}
+
+/* Picks an entry to hold a new sector using the clock algorithm.
+   Returns the entry with its lock held, still holding its old
+   sector, or a null pointer if every entry is locked by some
+   other thread.  Pass it to assign_entry().  cache_lock must be
+   held. */
+static struct cache_entry *
+evict (void)
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+
+  for (i = 0; i < 2 * CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[clock_hand];
+      clock_hand = (clock_hand + 1) % CACHE_CNT;
+
+      if (!lock_try_acquire (&e->lock))
+        continue;
+      if (!e->in_use)
+        return e;
+      if (e->pinned)
+        {
+          lock_release (&e->lock);
+          continue;
+        }
+      if (e->accessed)
+        {
+          e->accessed = false;
+          lock_release (&e->lock);
+          continue;
+        }
+      return e;
+    }
+  return NULL;
+}
+
+/* Makes entry E, returned by evict(), hold SECTOR.
+   If E's old sector is dirty, it is written back first with
+   cache_lock released, so that lookups of other sectors go on
+   meanwhile.  E keeps its old sector until the write is done, so
+   a thread looking that sector up waits on E's lock instead of
+   re-reading stale data from disk.  Having to write back at all
+   means dirty sectors are piling up, so the flush thread is
+   woken.
+   Returns false, with E's lock released, if another thread
+   cached SECTOR during the write.  cache_lock must be held. */
+static bool
+assign_entry (struct cache_entry *e, block_sector_t sector)
+{
+  ASSERT (lock_held_by_current_thread (&cache_lock));
+  ASSERT (lock_held_by_current_thread (&e->lock));
+
+  if (e->in_use && e->dirty)
+    {
+      lock_release (&cache_lock);
+      block_write (fs_device, e->sector, e->data);
+      e->dirty = false;
+      sema_up (&flush_sema);
+      lock_acquire (&cache_lock);
+
+      if (lookup (sector) != NULL)
+        {
+          e->in_use = false;
+          lock_release (&e->lock);
+          return false;
+        }
+    }
+  e->sector = sector;
+  e->in_use = true;
+  e->accessed = true;
+  e->dirty = false;
+  return true;
+}
+
+/* Returns the entry for SECTOR with its lock held, loading it
+   into the cache if necessary.  If LOAD is false and SECTOR is
+   not already cached, its contents are not read from disk,
+   because the caller is about to overwrite the whole sector. */
+static struct cache_entry *
+cache_lock_sector (block_sector_t sector, bool load)
+{
+  for (;;)
+    {
+      struct cache_entry *e;
+
+      lock_acquire (&cache_lock);
+      e = lookup (sector);
+      if (e != NULL)
+        {
+          e->accessed = true;
+          lock_release (&cache_lock);
+
+          /* The entry may have been recycled while we waited. */
+          lock_acquire (&e->lock);
+          if (e->in_use && e->sector == sector)
+            return e;
+          lock_release (&e->lock);
+          continue;
+        }
+
+      e = evict ();
+      if (e == NULL)
+        {
+          lock_release (&cache_lock);
+          thread_yield ();
+          continue;
+        }
+      if (!assign_entry (e, sector))
+        {
+          lock_release (&cache_lock);
+          continue;
+        }
+      lock_release (&cache_lock);
+
+      if (load)
+        block_read (fs_device, sector, e->data);
+      return e;
+    }
+}
+
+/* Reads sector SECTOR into BUFFER, which must have room for
+   BLOCK_SECTOR_SIZE bytes. */
+void
+cache_read (block_sector_t sector, void *buffer)
+{
+  cache_read_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Reads SIZE bytes starting at byte OFS within sector SECTOR
+   into BUFFER. */
+void
+cache_read_at (block_sector_t sector, void *buffer, off_t ofs, off_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_lock_sector (sector, true);
+  memcpy (buffer, e->data + ofs, size);
+  lock_release (&e->lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes from BUFFER into sector
+   SECTOR. */
+void
+cache_write (block_sector_t sector, const void *buffer)
+{
+  cache_write_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes from BUFFER into sector SECTOR, starting at
+   byte OFS within the sector. */
+void
+cache_write_at (block_sector_t sector, const void *buffer,
+                off_t ofs, off_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_lock_sector (sector, ofs != 0 || size != BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  lock_release (&e->lock);
+}
+
+/* Writes BLOCK_SECTOR_SIZE bytes of metadata from BUFFER into
+   sector SECTOR, as part of the running journal transaction. */
+void
+cache_write_meta (block_sector_t sector, const void *buffer)
+{
+  cache_write_meta_at (sector, buffer, 0, BLOCK_SECTOR_SIZE);
+}
+
+/* Writes SIZE bytes of metadata from BUFFER into sector SECTOR,
+   starting at byte OFS within the sector.  The sector joins the
+   running journal transaction and stays pinned in the cache
+   until the transaction commits. */
+void
+cache_write_meta_at (block_sector_t sector, const void *buffer,
+                     off_t ofs, off_t size)
+{
+  struct cache_entry *e;
+
+  ASSERT (ofs >= 0 && size >= 0 && ofs + size <= BLOCK_SECTOR_SIZE);
+
+  e = cache_lock_sector (sector, ofs != 0 || size != BLOCK_SECTOR_SIZE);
+  memcpy (e->data + ofs, buffer, size);
+  e->dirty = true;
+  if (!e->pinned)
+    e->pinned = journal_add (sector);
+  lock_release (&e->lock);
+}
+
+/* Lets SECTOR, which the journal has committed, be written back
+   and evicted again. */
+void
+cache_unpin (block_sector_t sector)
+{
+  struct cache_entry *e;
+
+  lock_acquire (&cache_lock);
+  e = lookup (sector);
+  lock_release (&cache_lock);
+
+  /* Pinned entries are never evicted. */
+  ASSERT (e != NULL);
+  lock_acquire (&e->lock);
+  ASSERT (e->sector == sector && e->pinned);
+  e->pinned = false;
+  lock_release (&e->lock);
+}
+
+/* Asks the read-ahead thread to load SECTOR into the cache.
+   Returns without waiting.  The request is silently dropped if
+   too many are already pending. */
+void
+cache_readahead (block_sector_t sector)
+{
+  lock_acquire (&readahead_lock);
+  if (readahead_cnt < READAHEAD_CNT)
+    {
+      readahead_queue[(readahead_head + readahead_cnt) % READAHEAD_CNT]
+        = sector;
+      readahead_cnt++;
+      cond_signal (&readahead_cond, &readahead_lock);
+    }
+  lock_release (&readahead_lock);
+}
+
+/* Loads the CNT sectors starting at SECTOR into the cache,
+   skipping those already cached.  Each run of uncached sectors
+   is read with one multi-sector request.  Gives up early if
+   every entry is busy. */
+static void
+load_run (block_sector_t sector, size_t cnt)
+{
+  size_t i = 0;
+
+  ASSERT (cnt <= RUN_MAX);
+
+  lock_acquire (&io_lock);
+  while (i < cnt)
+    {
+      struct cache_entry *run[RUN_MAX];
+      struct cache_entry *e = NULL;
+      block_sector_t start;
+      size_t run_cnt = 0;
+      size_t j;
+
+      /* Claim entries for the next run of uncached sectors.
+         Their locks keep other threads out until they hold the
+         data. */
+      lock_acquire (&cache_lock);
+      while (i < cnt && lookup (sector + i) != NULL)
+        i++;
+      start = sector + i;
+      for (; i < cnt && lookup (sector + i) == NULL; i++)
+        {
+          e = evict ();
+          if (e == NULL)
+            break;
+          if (!assign_entry (e, sector + i))
+            {
+              e = NULL;
+              break;
+            }
+          run[run_cnt++] = e;
+        }
+      lock_release (&cache_lock);
+
+      if (run_cnt > 0)
+        {
+          block_read_multi (fs_device, start, run_cnt, io_buffer);
+          for (j = 0; j < run_cnt; j++)
+            {
+              memcpy (run[j]->data, io_buffer + j * BLOCK_SECTOR_SIZE,
+                      BLOCK_SECTOR_SIZE);
+              lock_release (&run[j]->lock);
+            }
+        }
+      if (e == NULL)
+        break;
+    }
+  lock_release (&io_lock);
+}
+
+/* Read-ahead thread.  Loads queued sectors into the cache, so
+   the disk works while readers compute.  Requests for
+   consecutive sectors are merged into one. */
+static void
+readahead_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      block_sector_t sector;
+      size_t cnt;
+
+      lock_acquire (&readahead_lock);
+      while (readahead_cnt == 0)
+        cond_wait (&readahead_cond, &readahead_lock);
+      sector = readahead_queue[readahead_head];
+      cnt = 0;
+      do
+        {
+          readahead_head = (readahead_head + 1) % READAHEAD_CNT;
+          readahead_cnt--;
+          cnt++;
+        }
+      while (readahead_cnt > 0 && cnt < RUN_MAX
+             && readahead_queue[readahead_head] == sector + cnt);
+      lock_release (&readahead_lock);
+
+      load_run (sector, cnt);
+    }
+}
+
+/* Writes every dirty cached sector back to disk, in ascending
+   sector order to keep the disk head moving in one direction.
+   Runs of consecutive sectors are written with one request. */
+void
+cache_flush (void)
+{
+  struct cache_entry *dirty[CACHE_CNT];
+  block_sector_t sectors[CACHE_CNT];
+  size_t dirty_cnt = 0;
+  size_t i;
+
+  /* Take a snapshot of the dirty entries sorted by sector.
+     Entries may change before we lock them, so each one is
+     checked again below. */
+  lock_acquire (&cache_lock);
+  for (i = 0; i < CACHE_CNT; i++)
+    {
+      struct cache_entry *e = &cache[i];
+      size_t j;
+
+      if (!e->in_use || !e->dirty || e->pinned)
+        continue;
+      for (j = dirty_cnt; j > 0 && sectors[j - 1] > e->sector; j--)
+        {
+          dirty[j] = dirty[j - 1];
+          sectors[j] = sectors[j - 1];
+        }
+      dirty[j] = e;
+      sectors[j] = e->sector;
+      dirty_cnt++;
+    }
+  lock_release (&cache_lock);
+
+  lock_acquire (&io_lock);
+  i = 0;
+  while (i < dirty_cnt)
+    {
+      struct cache_entry *run[RUN_MAX];
+      block_sector_t start = sectors[i];
+      size_t run_cnt = 0;
+      size_t j;
+
+      /* Gather entries that still hold consecutive dirty sectors,
+         keeping them locked until they are written. */
+      while (i < dirty_cnt && run_cnt < RUN_MAX
+             && sectors[i] == start + run_cnt)
+        {
+          struct cache_entry *e = dirty[i++];
+
+          lock_acquire (&e->lock);
+          if (!e->in_use || !e->dirty || e->pinned
+              || e->sector != start + run_cnt)
+            {
+              lock_release (&e->lock);
+              break;
+            }
+          memcpy (io_buffer + run_cnt * BLOCK_SECTOR_SIZE, e->data,
+                  BLOCK_SECTOR_SIZE);
+          run[run_cnt++] = e;
+        }
+
+      if (run_cnt > 0)
+        block_write_multi (fs_device, start, run_cnt, io_buffer);
+      for (j = 0; j < run_cnt; j++)
+        {
+          run[j]->dirty = false;
+          lock_release (&run[j]->lock);
+        }
+    }
+  lock_release (&io_lock);
+}
+
+/* Write-behind thread.  Blocks until an eviction or the flush
+   timer ups flush_sema, then flushes the cache.  The journal
+   commits first, which also writes the free map's changes into
+   the cache, so they go out in the same batch. */
+static void
+flush_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      sema_down (&flush_sema);
+
+      /* One flush serves every request made so far. */
+      while (sema_try_down (&flush_sema))
+        continue;
+
+      journal_commit ();
+      cache_flush ();
+    }
+}
+
+/* Wakes the flush thread every cache_flush_ms milliseconds.  Only
+   started if cache_flush_ms is nonzero. */
+static void
+flush_timer (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_msleep (cache_flush_ms);
+      sema_up (&flush_sema);
+    }
+}
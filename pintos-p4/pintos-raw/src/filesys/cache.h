@@ -0,0 +1,22 @@
+#ifndef FILESYS_CACHE_H
+#define FILESYS_CACHE_H
+
+#include "devices/block.h"
+#include "filesys/off_t.h"
+
+/* Milliseconds between write-behind flushes (-flush=MS). */
+extern unsigned cache_flush_ms;
+
+void cache_init (void);
+void cache_flush (void);
+
+void cache_read (block_sector_t, void *);
+void cache_read_at (block_sector_t, void *, off_t ofs, off_t size);
+void cache_write (block_sector_t, const void *);
+void cache_write_at (block_sector_t, const void *, off_t ofs, off_t size);
+void cache_write_meta (block_sector_t, const void *);
+void cache_write_meta_at (block_sector_t, const void *, off_t ofs, off_t size);
+void cache_unpin (block_sector_t);
+void cache_readahead (block_sector_t);
+
+#endif /* filesys/cache.h */
@@ -0,0 +1,203 @@
+#include "filesys/dentry.h"
+#include <debug.h>
+#include <hash.h>
+#include <list.h>
+#include <string.h>
+#include "filesys/directory.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+
+/* Directory entry cache.
+
+   Remembers the result of looking up a name in a directory,
+   keyed by the directory's sector and the name, so that path
+   resolution does not have to read directories again.  Names
+   found not to exist are remembered too.
+
+   The directory code keeps the cache coherent: it only fills it
+   and invalidates it while holding the directory's inode lock.
+   At most DENTRY_CNT entries are kept, dropping the least
+   recently used. */
+
+/* Maximum number of cached entries. */
+#define DENTRY_CNT 256
+
+/* A cached lookup result. */
+struct dentry
+  {
+    struct hash_elem hash_elem;         /* Element in dentries. */
+    struct list_elem lru_elem;          /* Element in lru. */
+    block_sector_t dir;                 /* Directory's sector. */
+    char name[NAME_MAX + 1];            /* Name within DIR. */
+    enum dentry_state state;            /* What NAME is. */
+    block_sector_t sector;              /* NAME's inode, unless absent. */
+  };
+
+/* Cached entries, keyed by DIR and NAME. */
+static struct hash dentries;
+
+/* Cached entries, most recently used first. */
+static struct list lru;
+
+/* Protects DENTRIES and LRU. */
+static struct lock dentry_lock;
+
+static hash_hash_func dentry_hash;
+static hash_less_func dentry_less;
+
+/* Initializes the dentry cache. */
+void
+dentry_init (void)
+{
+  if (!hash_init (&dentries, dentry_hash, dentry_less, NULL))
+    PANIC ("couldn't allocate dentry cache");
+  list_init (&lru);
+  lock_init (&dentry_lock);
+}
+
+/* Returns a hash value for the dentry containing E. */
+static unsigned
+dentry_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct dentry *d = hash_entry (e, struct dentry, hash_elem);
+  return hash_string (d->name) ^ hash_int (d->dir);
+}
+
+/* Returns true if the dentry containing A orders before the one
+   containing B. */
+static bool
+dentry_less (const struct hash_elem *a_, const struct hash_elem *b_,
+             void *aux UNUSED)
+{
+  const struct dentry *a = hash_entry (a_, struct dentry, hash_elem);
+  const struct dentry *b = hash_entry (b_, struct dentry, hash_elem);
+
+  if (a->dir != b->dir)
+    return a->dir < b->dir;
+  return strcmp (a->name, b->name) < 0;
+}
+
+/* Returns the cached entry for NAME in DIR, or a null pointer.
+   dentry_lock must be held. */
+static struct dentry *
+find (block_sector_t dir, const char *name)
+{
+  struct dentry key;
+  struct hash_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&dentry_lock));
+
+  key.dir = dir;
+  strlcpy (key.name, name, sizeof key.name);
+  e = hash_find (&dentries, &key.hash_elem);
+  return e != NULL ? hash_entry (e, struct dentry, hash_elem) : NULL;
+}
+
+/* Removes D from the cache and frees it.
+   dentry_lock must be held. */
+static void
+discard (struct dentry *d)
+{
+  hash_delete (&dentries, &d->hash_elem);
+  list_remove (&d->lru_elem);
+  free (d);
+}
+
+/* Looks up NAME in the directory in sector DIR.  If the answer
+   is cached and NAME exists, stores its inode's sector in
+   *SECTOR. */
+enum dentry_state
+dentry_lookup (block_sector_t dir, const char *name, block_sector_t *sector)
+{
+  enum dentry_state state = DENTRY_UNKNOWN;
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return DENTRY_UNKNOWN;
+
+  lock_acquire (&dentry_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    {
+      list_remove (&d->lru_elem);
+      list_push_front (&lru, &d->lru_elem);
+      state = d->state;
+      *sector = d->sector;
+    }
+  lock_release (&dentry_lock);
+
+  return state;
+}
+
+/* Records that NAME in the directory in sector DIR is in the
+   given STATE, with its inode in SECTOR unless STATE is
+   DENTRY_ABSENT.  Does nothing if memory is short. */
+void
+dentry_insert (block_sector_t dir, const char *name,
+               enum dentry_state state, block_sector_t sector)
+{
+  struct dentry *d;
+
+  ASSERT (state != DENTRY_UNKNOWN);
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dentry_lock);
+  d = find (dir, name);
+  if (d == NULL)
+    {
+      if (hash_size (&dentries) >= DENTRY_CNT)
+        discard (list_entry (list_back (&lru), struct dentry, lru_elem));
+      d = malloc (sizeof *d);
+      if (d == NULL)
+        {
+          lock_release (&dentry_lock);
+          return;
+        }
+      d->dir = dir;
+      strlcpy (d->name, name, sizeof d->name);
+      hash_insert (&dentries, &d->hash_elem);
+    }
+  else
+    list_remove (&d->lru_elem);
+  list_push_front (&lru, &d->lru_elem);
+  d->state = state;
+  d->sector = sector;
+  lock_release (&dentry_lock);
+}
+
+/* Forgets anything cached about NAME in the directory in sector
+   DIR. */
+void
+dentry_invalidate (block_sector_t dir, const char *name)
+{
+  struct dentry *d;
+
+  if (strlen (name) > NAME_MAX)
+    return;
+
+  lock_acquire (&dentry_lock);
+  d = find (dir, name);
+  if (d != NULL)
+    discard (d);
+  lock_release (&dentry_lock);
+}
+
+/* Forgets everything cached about names in the directory in
+   sector DIR, which is being removed. */
+void
+dentry_invalidate_dir (block_sector_t dir)
+{
+  struct list_elem *e, *next;
+
+  lock_acquire (&dentry_lock);
+  for (e = list_begin (&lru); e != list_end (&lru); e = next)
+    {
+      struct dentry *d = list_entry (e, struct dentry, lru_elem);
+      next = list_next (e);
+      if (d->dir == dir)
+        discard (d);
+    }
+  lock_release (&dentry_lock);
+}
@@ -0,0 +1,23 @@
+#ifndef FILESYS_DENTRY_H
+#define FILESYS_DENTRY_H
+
+#include "devices/block.h"
+
+/* What the dentry cache knows about a name in a directory. */
+enum dentry_state
+  {
+    DENTRY_UNKNOWN,     /* Not cached. */
+    DENTRY_ABSENT,      /* Known not to exist. */
+    DENTRY_FILE,        /* Names an ordinary file. */
+    DENTRY_DIR          /* Names a directory. */
+  };
+
+void dentry_init (void);
+enum dentry_state dentry_lookup (block_sector_t dir, const char *name,
+                                 block_sector_t *sector);
+void dentry_insert (block_sector_t dir, const char *name,
+                    enum dentry_state, block_sector_t sector);
+void dentry_invalidate (block_sector_t dir, const char *name);
+void dentry_invalidate_dir (block_sector_t dir);
+
+#endif /* filesys/dentry.h */
@@ -1,4 +1,42 @@
 #include "filesys/directory.h"
+#include <hash.h>
+#include <round.h>
+#include "filesys/dentry.h"
+#include "filesys/journal.h"
+
+/* A directory is a linear hash table of buckets (struct
+   dir_bucket), one per sector.  With B buckets, let L be the
+   largest integer with 2**L <= B.  A name with hash H lives in
+   bucket H mod 2**L, or H mod 2**(L+1) if that is less than
+   B - 2**L.  When a name's bucket is full, the table grows by one
+   bucket, splitting bucket B - 2**L between itself and the new
+   bucket B, until there is room.  The number of buckets follows
+   from the directory's length, so no other state is stored.
+
+   Looking up, adding, or removing a name thus reads and writes
+   only the name's own bucket, however large the directory. */
+
+/* dir_readdir() and dir_readdir_entries() return entries in
+   order of their keys, the bits of their names' hashes in reverse
+   order, and then of their names.  Each bucket holds exactly the names whose keys lie
+   in one range, and a split divides that range between the two
+   buckets, so this order, unlike the entries' positions, does not
+   change as the directory grows.  A listing that remembers the
+   last key and name it returned therefore neither skips nor
+   repeats an entry that stays in the directory throughout. */
+
+/* Scan key past every name's key. */
+#define SCAN_END ((uint64_t) 1 << 32)
+
+/* Most buckets a directory may grow to.  Stops runaway splitting
+   when more than DIR_BUCKET_CNT names share a hash. */
+#define DIR_MAX_BUCKETS 4096
+
+static size_t bucket_cnt (const struct dir *);
+static size_t bucket_of (unsigned hash, size_t bucket_cnt);
+static bool read_bucket (const struct dir *, size_t, struct dir_bucket *);
+static bool write_bucket (struct dir *, size_t, const struct dir_bucket *);
+static bool split_bucket (struct dir *, struct dir_bucket *);
 
 
 /* Creates a directory in the given SECTOR with its parent in PARENT_SECTOR.
@@ -9,6 +47,8 @@ static bool initialize_directory_entries(struct inode *inode, block_sector_t sec
 static struct inode *create_and_initialize_inode(block_sector_t sector, block_sector_t parent_sector);
 
 struct inode *dir_create(block_sector_t sector, block_sector_t parent_sector) {
+  // nothing cached under an earlier user of SECTOR may survive
+  dentry_invalidate_dir(sector);
   struct inode *inode = create_and_initialize_inode(sector, parent_sector);
   if(inode == NULL){free_map_release(sector);}
   return inode;
@@ -29,15 +69,21 @@ static struct inode *create_and_initialize_inode(block_sector_t sector, block_se
 /* Initializes directory entries "." and ".." for a given inode.
    Returns true on success, false on failure. */
 static bool initialize_directory_entries(struct inode *inode, block_sector_t sector, block_sector_t parent_sector) {
-  struct dir_entry entry_arr[2] = {0};
-  // Initialize "." and ".." entry
-  for(int i = 0; i < 2; i++){
-    strlcpy(entry_arr[i].name, ".", sizeof entry_arr[i].name);
-    entry_arr[i].inode_sector = sector;
-    entry_arr[i].in_use = true;
+  // A new directory is a single bucket, which every name maps to
+  struct dir_bucket *bucket = calloc(1, sizeof *bucket);
+  if (bucket == NULL) {
+    return false;
   }
-  // Write entry_arr to inode
-  return inode_write_at(inode, entry_arr, sizeof entry_arr, 0) == sizeof entry_arr;
+  strlcpy(bucket->entries[0].name, ".", sizeof bucket->entries[0].name);
+  bucket->entries[0].inode_sector = sector;
+  bucket->entries[0].in_use = true;
+  strlcpy(bucket->entries[1].name, "..", sizeof bucket->entries[1].name);
+  bucket->entries[1].inode_sector = parent_sector;
+  bucket->entries[1].in_use = true;
+
+  bool ok = inode_write_at(inode, bucket, sizeof *bucket, 0) == sizeof *bucket;
+  free(bucket);
+  return ok;
 }
 
 
@@ -50,7 +96,6 @@ dir_open (struct inode *inode)
   if (inode != NULL && dir != NULL && inode_get_type(inode) == DIR_INODE)
     {
       dir->inode = inode;
-      dir->pos = 0;
       return dir;
     }
   else
@@ -97,33 +142,151 @@ dir_get_inode (struct dir *dir)
   return dir->inode;
 }
 
+/* Returns the number of buckets in DIR. */
+static size_t
+bucket_cnt (const struct dir *dir)
+{
+  return inode_length (dir->inode) / BLOCK_SECTOR_SIZE;
+}
+
+/* Returns the bucket that a name with the given HASH belongs in,
+   in a directory with BUCKET_CNT buckets. */
+static size_t
+bucket_of (unsigned hash, size_t bucket_cnt)
+{
+  size_t low = 1;
+  size_t b;
+
+  ASSERT (bucket_cnt > 0);
+
+  while (low * 2 <= bucket_cnt)
+    low *= 2;
+  b = hash & (low - 1);
+  if (b < bucket_cnt - low)
+    b = hash & (low * 2 - 1);
+  return b;
+}
+
+/* Reads bucket IDX of DIR into BUCKET.
+   Returns true if successful, false on failure. */
+static bool
+read_bucket (const struct dir *dir, size_t idx, struct dir_bucket *bucket)
+{
+  return (inode_read_at (dir->inode, bucket, sizeof *bucket,
+                         idx * sizeof *bucket)
+          == sizeof *bucket);
+}
+
+/* Writes BUCKET as bucket IDX of DIR.
+   Returns true if successful, false on failure. */
+static bool
+write_bucket (struct dir *dir, size_t idx, const struct dir_bucket *bucket)
+{
+  return (inode_write_at (dir->inode, bucket, sizeof *bucket,
+                          idx * sizeof *bucket)
+          == sizeof *bucket);
+}
+
+/* Grows DIR by one bucket, moving the entries of the next bucket
+   to split whose names now belong in the new bucket.  SCRATCH is
+   used as temporary space.
+   Returns true if successful, false on failure. */
+static bool
+split_bucket (struct dir *dir, struct dir_bucket *scratch)
+{
+  size_t old_cnt = bucket_cnt (dir);
+  size_t low = 1;
+  size_t victim, i;
+  struct dir_bucket *fresh;
+  bool ok;
+
+  /* The two buckets, the directory's inode, and up to two new
+     indirect blocks plus the one pointing to them join the
+     caller's journal handle, which must have room for them. */
+  if (old_cnt >= DIR_MAX_BUCKETS || !journal_extend (6))
+    return false;
+  while (low * 2 <= old_cnt)
+    low *= 2;
+  victim = old_cnt - low;
+
+  fresh = calloc (1, sizeof *fresh);
+  if (fresh == NULL || !read_bucket (dir, victim, scratch))
+    {
+      free (fresh);
+      return false;
+    }
+
+  for (i = 0; i < DIR_BUCKET_CNT; i++)
+    {
+      struct dir_entry *e = &scratch->entries[i];
+      if (e->in_use
+          && bucket_of (hash_string (e->name), old_cnt + 1) == old_cnt)
+        {
+          fresh->entries[i] = *e;
+          e->in_use = false;
+        }
+    }
+
+  /* Write the new bucket first, so a failure leaves the old
+     entries where lookups still find them. */
+  ok = write_bucket (dir, old_cnt, fresh) && write_bucket (dir, victim, scratch);
+  free (fresh);
+  return ok;
+}
+
 /* Searches DIR for a file with the given NAME.
    If successful, returns true, sets *EP to the directory entry
    if EP is non-null, and sets *OFSP to the byte offset of the
    directory entry if OFSP is non-null.
-   otherwise, returns false and ignores EP and OFSP. */
+   otherwise, returns false and ignores EP and OFSP.
+   Only NAME's bucket is read. */
 static bool
 lookup (const struct dir *dir, const char *name,
         struct dir_entry *ep, off_t *ofsp) 
 {
-  struct dir_entry e;
-  size_t ofs;
+  struct dir_bucket *bucket;
+  size_t idx, i;
+  bool found = false;
   
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (e.in_use && !strcmp (name, e.name)) 
+  bucket = malloc (sizeof *bucket);
+  if (bucket == NULL)
+    return false;
+
+  idx = bucket_of (hash_string (name), bucket_cnt (dir));
+  if (read_bucket (dir, idx, bucket))
+    for (i = 0; i < DIR_BUCKET_CNT; i++)
       {
-        if (ep != NULL)
-          *ep = e;
-        if (ofsp != NULL)
-          *ofsp = ofs;
-        return true;
+        struct dir_entry *e = &bucket->entries[i];
+        if (e->in_use && !strcmp (name, e->name)) 
+          {
+            if (ep != NULL)
+              *ep = *e;
+            if (ofsp != NULL)
+              *ofsp = idx * sizeof *bucket + i * sizeof *e;
+            found = true;
+            break;
+          }
       }
 
-  return false;
+  free (bucket);
+  return found;
+}
+
+/* Reads the next entry in INODE, a directory, at or after *POS
+   into *E and advances *POS past it, skipping the unused tail of
+   each bucket.  Returns false at the end of the directory. */
+static bool
+next_entry (struct inode *inode, off_t *pos, struct dir_entry *e)
+{
+  if (*pos % BLOCK_SECTOR_SIZE >= (off_t) (DIR_BUCKET_CNT * sizeof *e))
+    *pos = ROUND_UP (*pos, BLOCK_SECTOR_SIZE);
+  if (inode_read_at (inode, e, sizeof *e, *pos) != sizeof *e)
+    return false;
+  *pos += sizeof *e;
+  return true;
 }
 
 /* Searches DIR for a file with the given NAME
@@ -135,18 +298,67 @@ dir_lookup (const struct dir *dir, const char *name,
             struct inode **inode) 
 {
   struct dir_entry e;
+  block_sector_t dir_sector, sector;
 
   ASSERT (dir != NULL);
   ASSERT (name != NULL);
 
+  // Try the dentry cache first, and fill it on a miss.
+  // The directory's lock keeps the cache in step with dir_add
+  // and dir_remove. A removed directory is not cached: its
+  // entries were dropped when it was removed, and its sector
+  // will be reused.
+  dir_sector = inode_get_inumber(dir->inode);
   inode_lock(dir->inode);
-  bool ok = lookup(dir, name, &e, NULL);
+  bool cacheable = !inode_is_removed(dir->inode);
+  switch (dentry_lookup(dir_sector, name, &sector)) {
+    case DENTRY_ABSENT:
+      *inode = NULL;
+      break;
+    case DENTRY_FILE:
+    case DENTRY_DIR:
+      *inode = inode_open(sector);
+      break;
+    default:
+      if (lookup(dir, name, &e, NULL)) {
+        *inode = inode_open(e.inode_sector);
+        if (*inode != NULL && cacheable) {
+          dentry_insert(dir_sector, name,
+                        inode_get_type(*inode) == DIR_INODE ? DENTRY_DIR : DENTRY_FILE,
+                        e.inode_sector);
+        }
+      } else {
+        *inode = NULL;
+        if (cacheable) {
+          dentry_insert(dir_sector, name, DENTRY_ABSENT, 0);
+        }
+      }
+      break;
+  }
   inode_unlock(dir->inode);
 
-  *inode = ok ? inode_open(e.inode_sector) : NULL;
   return *inode != NULL;
 }
 
+/* Looks up NAME in DIR.  If it names a directory, opens it and
+   returns it; otherwise returns a null pointer.  The directory is
+   opened by dir_lookup() under DIR's lock, so it cannot be removed
+   and its sector reused between finding and opening it. */
+struct dir *
+dir_lookup_subdir (const struct dir *dir, const char *name)
+{
+  struct inode *inode;
+
+  if (!dir_lookup (dir, name, &inode))
+    return NULL;
+  if (inode_get_type (inode) != DIR_INODE)
+    {
+      inode_close (inode);
+      return NULL;
+    }
+  return dir_open (inode);
+}
+
 /* Adds a file named NAME to DIR, which must not already contain a
    file by that name.  The file's inode is in sector
    INODE_SECTOR.
@@ -156,8 +368,10 @@ dir_lookup (const struct dir *dir, const char *name,
 bool
 dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
 {
-  struct dir_entry e;
-  off_t ofs;
+  struct dir_bucket *bucket;
+  struct dir_entry *e;
+  unsigned hash;
+  size_t idx, i;
   bool success = false;
 
   ASSERT (dir != NULL);
@@ -167,34 +381,93 @@ dir_add (struct dir *dir, const char *name, block_sector_t inode_sector)
   if (*name == '\0' || strlen (name) > NAME_MAX || strchr (name, '/') )
     return false;
 
+  bucket = malloc (sizeof *bucket);
+  if (bucket == NULL)
+    return false;
+
   /* Check that NAME is not in use. */
   inode_lock(dir->inode);
   if (lookup (dir, name, NULL, NULL))
     goto done;
 
-  /* Set OFS to offset of free slot.
-     If there are no free slots, then it will be set to the
-     current end-of-file.
-     
-     inode_read_at() will only return a short read at end of file.
-     Otherwise, we'd need to verify that we didn't get a short
-     read due to something intermittent such as low memory. */
-  for (ofs = 0; inode_read_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
-       ofs += sizeof e) 
-    if (!e.in_use)
-      break;
+  /* Find a free slot in NAME's bucket, splitting buckets until
+     there is one. */
+  hash = hash_string (name);
+  for (;;)
+    {
+      idx = bucket_of (hash, bucket_cnt (dir));
+      if (!read_bucket (dir, idx, bucket))
+        goto done;
+      for (i = 0; i < DIR_BUCKET_CNT; i++)
+        if (!bucket->entries[i].in_use)
+          break;
+      if (i < DIR_BUCKET_CNT)
+        break;
+      if (!split_bucket (dir, bucket))
+        goto done;
+    }
 
   /* Write slot. */
-  e.in_use = true;
-  strlcpy (e.name, name, sizeof e.name);
-  e.inode_sector = inode_sector;
-  success = inode_write_at (dir->inode, &e, sizeof e, ofs) == sizeof e;
+  e = &bucket->entries[i];
+  e->in_use = true;
+  strlcpy (e->name, name, sizeof e->name);
+  e->inode_sector = inode_sector;
+  success = write_bucket (dir, idx, bucket);
+  dentry_invalidate (inode_get_inumber (dir->inode), name);
 
  done:
   inode_unlock(dir->inode);
+  free (bucket);
   return success;
 }
 
+/* Splits buckets of DIR until NAME's bucket has a free slot, so
+   that a following dir_add() for NAME need not split.  Each split
+   is journaled in a handle of its own, since a directory may need
+   more splits than one transaction can hold.  Must be called
+   outside any journal handle.
+   Returns true if successful, false on failure.  Fails without
+   splitting anything if DIR already has an entry for NAME, since
+   dir_add() would then fail anyway. */
+bool
+dir_make_room (struct dir *dir, const char *name)
+{
+  struct dir_bucket *bucket;
+  unsigned hash = hash_string (name);
+  bool full = true;
+  bool ok = true;
+  size_t i;
+
+  ASSERT (dir != NULL);
+
+  bucket = malloc (sizeof *bucket);
+  if (bucket == NULL)
+    return false;
+
+  while (ok && full)
+    {
+      journal_begin ();
+      inode_lock (dir->inode);
+      ok = read_bucket (dir, bucket_of (hash, bucket_cnt (dir)), bucket);
+      if (ok)
+        {
+          full = true;
+          for (i = 0; i < DIR_BUCKET_CNT; i++)
+            if (!bucket->entries[i].in_use)
+              full = false;
+            else if (!strcmp (name, bucket->entries[i].name))
+              ok = false;
+          if (ok && full)
+            ok = split_bucket (dir, bucket);
+        }
+      inode_unlock (dir->inode);
+      journal_end ();
+    }
+
+  free (bucket);
+  return ok;
+}
+
 /* Removes any entry for NAME in DIR.
    Returns true if successful, false on failure,
    which occurs only if there is no file with the given NAME. */
@@ -208,8 +481,7 @@ static bool is_removable_directory(struct inode *inode) {
   off_t scan_offset = 0;
   int in_use_count = 0;
 
-  while (inode_read_at(inode, &scan_entry, sizeof scan_entry, scan_offset) == sizeof scan_entry) {
-    scan_offset += sizeof scan_entry;
+  while (next_entry(inode, &scan_offset, &scan_entry)) {
     if (scan_entry.in_use) {
       in_use_count++;
     }
@@ -255,6 +527,10 @@ bool dir_remove(struct dir *dir, const char *name) {
   // Erase directory entry
   e.in_use = false;
   if (inode_write_at(dir->inode, &e, sizeof e, ofs) == sizeof e) {
+    dentry_invalidate(inode_get_inumber(dir->inode), name);
+    if (inode_get_type(inode) == DIR_INODE) {
+      dentry_invalidate_dir(e.inode_sector);
+    }
     inode_remove(inode);
     success = true;
   }
@@ -265,32 +541,144 @@ bool dir_remove(struct dir *dir, const char *name) {
 }
 
 
-/* Reads the next directory entry in DIR and stores the name in
-   NAME.  Returns true if successful, false if the directory
-   contains no more entries. */
-
 /* Checks if a directory entry name is valid (not "." or ".."). */
 static bool is_valid_entry(const char *entry_name) {
   return strcmp(entry_name, ".") != 0 && strcmp(entry_name, "..") != 0;
 }
 
-bool dir_readdir(struct dir *dir, char name[NAME_MAX + 1]) {
+
+/* Returns X with its 32 bits in reverse order. */
+static unsigned
+reverse_bits (unsigned x)
+{
+  unsigned r = 0;
+  int i;
+
+  for (i = 0; i < 32; i++)
+    {
+      r = (r << 1) | (x & 1);
+      x >>= 1;
+    }
+  return r;
+}
+
+/* Returns the scan key of NAME. */
+static uint64_t
+scan_key (const char *name)
+{
+  return reverse_bits (hash_string (name));
+}
+
+/* Returns true if entry (KEY, NAME) comes after (KEY2, NAME2) in
+   scan order. */
+static bool
+scan_after (uint64_t key, const char *name, uint64_t key2, const char *name2)
+{
+  return key > key2 || (key == key2 && strcmp (name, name2) > 0);
+}
+
+/* Returns the bucket of a directory with BUCKET_CNT buckets that
+   holds the names with scan key KEY, and stores the first key
+   past them into *END. */
+static size_t
+scan_bucket (uint64_t key, size_t bucket_cnt, uint64_t *end)
+{
+  size_t b = bucket_of (reverse_bits (key), bucket_cnt);
+  size_t low = 1;
+  int bits = 0;
+
+  while (low * 2 <= bucket_cnt)
+    {
+      low *= 2;
+      bits++;
+    }
+  if (b < bucket_cnt - low)
+    bits++;
+  *end = (key >> (32 - bits) << (32 - bits)) + ((uint64_t) 1 << (32 - bits));
+  return b;
+}
+
+/* Reads up to CNT of the next entries in DIR, other than "." and
+   "..", into ENTRIES, in scan order, with each entry's inode
+   number, type and length.  Each entry's inode is opened for its
+   type and length while DIR's lock is held, so the entry cannot
+   be removed and its sector reused in between.  Returns the
+   number of entries read, which is 0 at the end of the
+   directory. */
+size_t dir_readdir_entries(struct dir *dir, struct dirent entries[], size_t cnt) {
   ASSERT(dir != NULL);
-  ASSERT(name != NULL);
+  ASSERT(entries != NULL);
+
+  struct dir_bucket *bucket = malloc(sizeof *bucket);
+  if (bucket == NULL) {
+    return 0;
+  }
 
   inode_lock(dir->inode);
+  size_t n = 0;
+  while (n < cnt && dir->scan_key < SCAN_END) {
+    // the bucket that holds the last entry returned
+    uint64_t end;
+    size_t idx = scan_bucket(dir->scan_key, bucket_cnt(dir), &end);
+    if (!read_bucket(dir, idx, bucket)) {
+      break;
+    }
+
+    // return its entries after that one, least first
+    for (; n < cnt; n++) {
+      const struct dir_entry *next = NULL;
+      uint64_t next_key = 0;
+      for (size_t i = 0; i < DIR_BUCKET_CNT; i++) {
+        const struct dir_entry *e = &bucket->entries[i];
+        if (e->in_use && is_valid_entry(e->name)) {
+          uint64_t key = scan_key(e->name);
+          if (scan_after(key, e->name, dir->scan_key, dir->scan_name)
+              && (next == NULL || scan_after(next_key, next->name, key, e->name))) {
+            next = e;
+            next_key = key;
+          }
+        }
+      }
+      if (next == NULL) {
+        break;
+      }
 
-  struct dir_entry entry;
-  bool is_entry_found = false;
-  while (!is_entry_found && inode_read_at(dir->inode, &entry, sizeof entry, dir->pos) == sizeof entry) {
-    dir->pos += sizeof entry;
-    if (entry.in_use && is_valid_entry(entry.name)) {
-      strlcpy(name, entry.name, NAME_MAX + 1);
-      is_entry_found = true;
+      struct dirent *d = &entries[n];
+      struct inode *inode = inode_open(next->inode_sector);
+      d->inumber = next->inode_sector;
+      d->is_dir = inode != NULL && inode_get_type(inode) == DIR_INODE;
+      d->length = inode != NULL ? inode_length(inode) : 0;
+      strlcpy(d->name, next->name, sizeof d->name);
+      inode_close(inode);
+
+      dir->scan_key = next_key;
+      strlcpy(dir->scan_name, next->name, sizeof dir->scan_name);
     }
-  }
 
+    if (n < cnt) {
+      // nothing left in the bucket: go on to the next one
+      dir->scan_key = end;
+      dir->scan_name[0] = '\0';
+    }
+  }
   inode_unlock(dir->inode);
-  return is_entry_found;
+
+  free(bucket);
+  return n;
 }
 
+/* Reads the next directory entry in DIR and stores the name in
+   NAME.  Returns true if successful, false if the directory
+   contains no more entries.  Shares its position with
+   dir_readdir_entries(), so the two can be mixed on one DIR. */
+bool dir_readdir(struct dir *dir, char name[NAME_MAX + 1]) {
+  ASSERT(dir != NULL);
+  ASSERT(name != NULL);
+
+  struct dirent entry;
+  if (dir_readdir_entries(dir, &entry, 1) == 0) {
+    return false;
+  }
+  strlcpy(name, entry.name, NAME_MAX + 1);
+  return true;
+}
@@ -7,6 +7,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <list.h>
+#include <dirent.h>
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
@@ -17,13 +18,21 @@
    retained, but much longer full path names must be allowed. */
 #define NAME_MAX 14
 
+/* getdents() copies names into struct dirent as they are. */
+#if DIRENT_NAME_MAX != NAME_MAX
+#error DIRENT_NAME_MAX in <dirent.h> must equal NAME_MAX
+#endif
+
 struct inode;
 
 /* A directory. */
 struct dir 
   {
     struct inode *inode;                /* Backing store. */
-    off_t pos;                          /* Current position. */
+
+    /* Last entry returned by dir_readdir() or dir_readdir_entries(). */
+    uint64_t scan_key;                  /* Its key, SCAN_END at the end. */
+    char scan_name[NAME_MAX + 1];       /* Its name. */
   };
 
 /* A single directory entry. */
@@ -34,6 +43,19 @@ struct dir_entry
     bool in_use;                        /* In use or free? */
   };
 
+/* Directory entries are stored in buckets of one sector each.
+   A name's bucket is chosen by hashing the name (see
+   directory.c), so a lookup reads a single sector. */
+#define DIR_BUCKET_CNT (BLOCK_SECTOR_SIZE / sizeof (struct dir_entry))
+
+/* A bucket of directory entries. */
+struct dir_bucket
+  {
+    struct dir_entry entries[DIR_BUCKET_CNT];
+    uint8_t unused[BLOCK_SECTOR_SIZE
+                   - DIR_BUCKET_CNT * sizeof (struct dir_entry)];
+  };
+
 /* Opening and closing directories. */
 struct inode *dir_create (block_sector_t sector, block_sector_t parent_sector);
 struct dir *dir_open (struct inode *);
@@ -44,8 +66,11 @@ struct inode *dir_get_inode (struct dir *);
 
 /* Reading and writing. */
 bool dir_lookup (const struct dir *, const char *name, struct inode **);
+struct dir *dir_lookup_subdir (const struct dir *, const char *name);
 bool dir_add (struct dir *, const char *name, block_sector_t);
+bool dir_make_room (struct dir *, const char *name);
 bool dir_remove (struct dir *, const char *name);
 bool dir_readdir (struct dir *, char name[NAME_MAX + 1]);
+size_t dir_readdir_entries (struct dir *, struct dirent[], size_t cnt);
 
 #endif /* filesys/directory.h */
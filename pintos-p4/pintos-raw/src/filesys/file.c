@@ -3,6 +3,12 @@
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Smallest and largest read-ahead windows, in bytes. */
+#define RA_MIN_WINDOW (2 * BLOCK_SECTOR_SIZE)
+#define RA_MAX_WINDOW (16 * BLOCK_SECTOR_SIZE)
 
 /* Creates a file in the given SECTOR,
 initially LENGTH bytes long.
@@ -11,23 +17,16 @@ On failure, SECTOR is released in the free map. */
 struct inode *
 file_create (block_sector_t sector, off_t length) 
 {
-  char* buffer = calloc(1, length);
-
   struct inode *inode = inode_create (sector, FILE_INODE);
   if (inode==NULL){
-     free(buffer);
     return NULL;
   }
-  off_t a = inode_write_at (inode, buffer, length, 0);
-  if (a < length){
+  // The file starts out as a hole; sectors are allocated as they are written.
+  if (!inode_extend (inode, length)){
     inode_remove(inode);
     inode_close(inode);
-    free(buffer);
     return NULL;
   }
-  // free the buffer
-
-  free(buffer);
   return inode;
 }
 
@@ -44,6 +43,9 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->ra_next = 0;
+      file->ra_end = 0;
+      file->ra_window = 0;
       return file;
     }
   else
@@ -82,6 +84,41 @@ file_get_inode (struct file *file)
   return file->inode;
 }
 
+/* Records that SIZE bytes were just read from FILE at offset
+   OFS.  If the read continued where the previous one stopped,
+   grows the read-ahead window (doubling up to RA_MAX_WINDOW) and
+   asks the inode layer to prefetch that far past the read.  Any
+   other read turns read-ahead off until reads are sequential
+   again. */
+static void
+file_readahead (struct file *file, off_t ofs, off_t size)
+{
+  off_t end = ofs + size;
+
+  if (size > 0 && ofs == file->ra_next)
+    {
+      if (file->ra_window == 0)
+        file->ra_window = RA_MIN_WINDOW;
+      else if (file->ra_window < RA_MAX_WINDOW)
+        file->ra_window *= 2;
+
+      if (file->ra_end < end)
+        file->ra_end = end;
+      if (file->ra_end < end + file->ra_window)
+        {
+          inode_readahead (file->inode, end + file->ra_window - file->ra_end,
+                           file->ra_end);
+          file->ra_end = end + file->ra_window;
+        }
+    }
+  else
+    {
+      file->ra_window = 0;
+      file->ra_end = end;
+    }
+  file->ra_next = end;
+}
+
 /* Reads SIZE bytes from FILE into BUFFER,
    starting at the file's current position.
    Returns the number of bytes actually read,
@@ -91,6 +128,7 @@ off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
   off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  file_readahead (file, file->pos, bytes_read);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -103,7 +141,9 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
-  return inode_read_at (file->inode, buffer, size, file_ofs);
+  off_t bytes_read = inode_read_at (file->inode, buffer, size, file_ofs);
+  file_readahead (file, file_ofs, bytes_read);
+  return bytes_read;
 }
 
 /* Writes SIZE bytes from BUFFER into FILE,
@@ -136,6 +176,53 @@ file_write_at (struct file *file, const void *buffer, off_t size,
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Copies up to SIZE bytes from SRC, starting at its current
+   position, to DST at its current position, a page at a time
+   through a kernel buffer, so the data never passes through user
+   memory.  Returns the number of bytes copied, which may be less
+   than SIZE if the end of SRC is reached or a write comes up
+   short, or -1 if no buffer can be allocated.  Advances both
+   positions by the number of bytes copied. */
+off_t
+file_copy (struct file *dst, struct file *src, off_t size)
+{
+  uint8_t *buffer = palloc_get_page (0);
+  off_t bytes_copied = 0;
+
+  if (buffer == NULL)
+    return -1;
+
+  while (size > 0)
+    {
+      off_t chunk_size = size < PGSIZE ? size : PGSIZE;
+      off_t bytes_read = file_read (src, buffer, chunk_size);
+      off_t bytes_written = file_write (dst, buffer, bytes_read);
+
+      bytes_copied += bytes_written;
+      if (bytes_written < chunk_size)
+        {
+          /* Give back what was read but not written. */
+          src->pos -= bytes_read - bytes_written;
+          break;
+        }
+      size -= chunk_size;
+    }
+
+  palloc_free_page (buffer);
+  return bytes_copied;
+}
+
+/* Reserves contiguous space on disk for the SIZE bytes of FILE
+   starting at offset FILE_OFS, so that later writes there need
+   not allocate, extending FILE if it is shorter.  Returns true
+   if successful, false if writes to FILE are denied or the range
+   is too large.  The file's current position is unaffected. */
+bool
+file_allocate (struct file *file, off_t file_ofs, off_t size)
+{
+  return inode_reserve (file->inode, file_ofs, size);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
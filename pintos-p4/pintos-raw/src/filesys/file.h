@@ -10,6 +10,11 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+
+    /* Sequential read detection. */
+    off_t ra_next;              /* Offset a sequential read starts at. */
+    off_t ra_end;               /* End of bytes already read ahead. */
+    off_t ra_window;            /* Read-ahead window in bytes, 0 if off. */
   };
 
 struct inode;
@@ -25,6 +30,8 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_copy (struct file *dst, struct file *src, off_t size);
+bool file_allocate (struct file *, off_t start, off_t size);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
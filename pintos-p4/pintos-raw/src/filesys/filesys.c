@@ -2,34 +2,46 @@
 #include <debug.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dentry.h"
 #include "filesys/file.h"
 #include "filesys/free-map.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
 #include "filesys/directory.h"
 #include "threads/thread.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
-static void do_format (void);
+static void do_format (enum inode_layout);
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system, giving its
+   inodes the given LAYOUT.  Otherwise new inodes use the same
+   layout as the root directory. */
 void
-filesys_init (bool format) 
+filesys_init (bool format, enum inode_layout layout) 
 {
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
   inode_init ();
+  dentry_init ();
+  cache_init ();
   free_map_init ();
   //above are ok. 
 
   if (format) 
-    do_format ();
+    do_format (layout);
 
+  journal_init ();
   free_map_open ();
+
+  struct inode *root = inode_open (ROOT_DIR_SECTOR);
+  inode_set_layout (inode_get_layout (root));
+  inode_close (root);
 }
 
 /* Shuts down the file system module, writing any unwritten data
@@ -37,7 +49,10 @@ filesys_init (bool format)
 void
 filesys_done (void) 
 {
+  inode_reclaim ();
+  journal_done ();
   free_map_close ();
+  cache_flush ();
 }
 
 /* Extracts a file name part from *SRCP into PART,
@@ -76,10 +91,11 @@ get_next_part (char part[NAME_MAX], const char **srcp)
 /* Resolves relative or absolute file NAME.
    Returns true if successful, false on failure.
    Stores the directory corresponding to the name into *DIRP,
-   and the file name part into BASE_NAME. */
+   and the file name part into BASE_NAME.
+   Each directory on the way is kept open while the next one is
+   looked up in it, so it cannot be removed in the meantime. */
 static bool resolve_name_to_entry(const char* name, struct dir **dirp, char base_name[NAME_MAX + 1]) {
-  struct dir *dir = NULL;
-  struct inode *inode = NULL;
+  struct dir *dir;
   const char *cp = name;
   char part[NAME_MAX + 1];
   bool success = false;
@@ -90,8 +106,6 @@ static bool resolve_name_to_entry(const char* name, struct dir **dirp, char base
   } else {
     dir = dir_reopen(thread_current()->cwd);
   }
-
-  // Check if starting directory is valid
   if (dir == NULL) {
     return false;
   }
@@ -110,12 +124,9 @@ static bool resolve_name_to_entry(const char* name, struct dir **dirp, char base
       break;
     }
 
-    if (!dir_lookup(dir, part, &inode)) {
-      break;
-    }
-
+    struct dir *next = dir_lookup_subdir(dir, part);
     dir_close(dir);
-    dir = dir_open(inode);
+    dir = next;
     if (dir == NULL) {
       break;
     }
@@ -175,8 +186,29 @@ bool filesys_create(const char *name, off_t initial_size, enum inode_type type)
   struct inode *inode;
 
   bool success = resolve_name_to_entry(name, &dir, entry);
-  if (success) {
-    success = free_map_allocate(&inode_sector);
+  if (!success) {
+    return false;
+  }
+
+  // Files go near their directory; directories are spread out
+  // over the allocation groups.
+  block_sector_t parent = inode_get_inumber(dir_get_inode(dir));
+  block_sector_t goal = type == DIR_INODE ? free_map_dir_goal(parent) : parent;
+
+  // Grow the directory first, one transaction per split, so the
+  // handle below only has to hold the inode and its entry. This
+  // also fails, without splitting, if ENTRY already exists.
+  if (!dir_make_room(dir, entry)) {
+    dir_close(dir);
+    return false;
+  }
+
+  // The inode and its directory entry are committed together.
+  journal_begin();
+  success = free_map_allocate_near(goal, &inode_sector);
+  if (!success && inode_reclaim()) {
+    // Space was only waiting to be freed by the reclaim thread.
+    success = free_map_allocate_near(goal, &inode_sector);
   }
 
   if (success) {
@@ -195,9 +227,8 @@ bool filesys_create(const char *name, off_t initial_size, enum inode_type type)
     }
   }
 
-  if (dir) {
-    dir_close(dir);  // Close directory regardless of success
-  }
+  journal_end();
+  dir_close(dir);
 
   return success;
 }
@@ -232,7 +263,9 @@ filesys_remove (const char *name)
     {
       return false;
     }
+    journal_begin ();
     bool ok = dir_remove (dir, entry);
+    journal_end ();
     dir_close (dir);
     return ok;
 }
@@ -253,16 +286,20 @@ filesys_chdir (const char *name)
     return false;
 }
 
-/* Formats the file system. */
+/* Formats the file system with inodes of the given LAYOUT. */
 static void
-do_format (void)
+do_format (enum inode_layout layout)
 {
   struct inode *inode;
   printf ("Formatting file system...");
+  inode_set_layout (layout);
 
   /* Set up free map. */
   free_map_create ();
 
+  /* Set up journal. */
+  journal_create ();
+
   /* Set up root directory. */
   inode = dir_create (ROOT_DIR_SECTOR, ROOT_DIR_SECTOR);
 
@@ -8,11 +8,12 @@
 /* Sectors of system file inodes. */
 #define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
 #define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+#define JOURNAL_SECTOR 2        /* Journal superblock sector. */
 
 /* Block device that contains the file system. */
 struct block *fs_device;
 
-void filesys_init (bool format);
+void filesys_init (bool format, enum inode_layout);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size, enum inode_type);
 struct inode *filesys_open (const char *name);
@@ -1,66 +1,381 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
+#include "filesys/journal.h"
+#include "threads/malloc.h"
 #include "threads/synch.h"
 
 /* TA note: locks added here for concurrency control, as 
    now there can be multiple accesses to the free_map simultaneously */
 
+/* The free map has one bit per sector, set if the sector is in
+   use, packed into 32-bit words.  This is the same layout that
+   lib/kernel/bitmap.c uses, so the free map file's format is
+   unchanged.
+
+   A second, summary level has one bit per word of the free map,
+   set if every sector in that word is in use.  Searches skip
+   full words 32 at a time through the summary and find the
+   first free sector within a word with a single bit scan.
+
+   Every search starts at a goal sector chosen by the caller
+   rather than at sector 0, so that allocation does not slow down
+   as the start of the disk fills up.
+
+   The disk is divided into allocation groups of GROUP_SECTORS
+   sectors, and the number of sectors in use in each group is
+   kept up to date.  New directories go in the group with the
+   most free space (free_map_dir_goal()); files go near their
+   directory, and their data after their previous block, so that
+   a directory's inodes and files end up close together.
+
+   Each sector-sized chunk of the free map that changes is marked
+   dirty, and free_map_flush() writes only the dirty chunks into
+   the free map file.  The flush thread calls it just before
+   flushing the buffer cache, so the free map reaches the disk
+   in the same batch as the inodes that its changes belong to.
+
+   Sectors that the journal may still replay are not reused
+   until the journal is checkpointed, or replay could overwrite
+   file data written there.  Freeing them only marks them in
+   DEFERRED; they are already free in the copy written to disk.
+
+   Sectors reserved for a file by free_map_reserve() are in use
+   in memory but marked in RESERVED, and also written to disk as
+   free, until the file claims them with free_map_claim().  A
+   crash therefore cannot leak a reservation. */
+
+typedef uint32_t map_word;
+#define WORD_BITS (sizeof (map_word) * CHAR_BIT)
+#define FULL_WORD ((map_word) -1)
+
 static struct file *free_map_file;   /* Free map file. */
-static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static map_word *free_map;           /* Free map, one bit per sector. */
+static map_word *summary;            /* One bit per full FREE_MAP word. */
+static size_t sector_cnt;            /* Number of sectors on disk. */
+static size_t map_words;             /* Number of words in FREE_MAP. */
+static size_t summary_words;         /* Number of words in SUMMARY. */
+static size_t *group_used;           /* Sectors in use per group. */
+static size_t group_cnt;             /* Number of allocation groups. */
 static struct lock free_map_lock;    /* Mutual exclusion. */
 
-/* In-memory inode. */
-struct inode 
-  {
-    //if not opened, not used yet since not in open_inodes list. 
-    struct list_elem elem;              /* Element in inode list. */
-    //sector will be used to locate inode disk
-    block_sector_t sector;              /* Sector number of disk location. */
-    int open_cnt;                       /* Number of openers. */
-    bool removed;                       /* True if deleted, false otherwise. */
-    //no two threads can modify an inode at the same time. 
-    struct lock lock;                   /* Protects the inode. */
-
-    /* Denying writes. */
-    struct lock deny_write_lock;        /* Protects members below. */
-    struct condition no_writers_cond;   /* Signaled when no writers. */
-    int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
-    int writer_cnt;                     /* Number of writers. */
-  };
+/* Sectors and free map words per allocation group. */
+#define GROUP_SECTORS 2048
+#define GROUP_WORDS (GROUP_SECTORS / WORD_BITS)
+
+/* Free map words per sector of the free map file. */
+#define CHUNK_WORDS (BLOCK_SECTOR_SIZE / sizeof (map_word))
+
+static struct bitmap *dirty_chunks;  /* Chunks changed since written. */
+static struct lock flush_lock;       /* Serializes free_map_flush(). */
+
+static map_word *deferred;           /* Freed, but not reusable yet. */
+static bool any_deferred;            /* Any bits set in DEFERRED? */
+
+static map_word *reserved;           /* Reserved, not yet claimed. */
+
+/* Returns the index of the lowest clear bit in WORD, which must
+   not be FULL_WORD. */
+static inline unsigned
+first_clear (map_word word)
+{
+  ASSERT (word != FULL_WORD);
+  return __builtin_ctz (~word);
+}
+
+/* Returns the number of set bits in WORD. */
+static inline unsigned
+count_bits (map_word word)
+{
+  word = word - ((word >> 1) & 0x55555555);
+  word = (word & 0x33333333) + ((word >> 2) & 0x33333333);
+  return (((word + (word >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+/* Returns true if SECTOR is in use. */
+static inline bool
+test_sector (size_t sector)
+{
+  return (free_map[sector / WORD_BITS] >> (sector % WORD_BITS)) & 1;
+}
+
+/* Updates the summary bit for word W of the free map. */
+static inline void
+update_summary (size_t w)
+{
+  map_word mask = (map_word) 1 << (w % WORD_BITS);
+  if (free_map[w] == FULL_WORD)
+    summary[w / WORD_BITS] |= mask;
+  else
+    summary[w / WORD_BITS] &= ~mask;
+}
+
+/* Stores VALUE into word W of the free map, keeping the summary
+   and the group's count of sectors in use up to date. */
+static void
+store_word (size_t w, map_word value)
+{
+  size_t *used = &group_used[w / GROUP_WORDS];
+
+  *used -= count_bits (free_map[w]);
+  *used += count_bits (value);
+  free_map[w] = value;
+  update_summary (w);
+}
+
+/* Marks the CNT sectors starting at SECTOR as in use if VALUE is
+   true, or as free otherwise. */
+static void
+set_sectors (size_t sector, size_t cnt, bool value)
+{
+  while (cnt > 0)
+    {
+      size_t w = sector / WORD_BITS;
+      size_t ofs = sector % WORD_BITS;
+      size_t n = WORD_BITS - ofs < cnt ? WORD_BITS - ofs : cnt;
+      map_word mask = (n == WORD_BITS
+                       ? FULL_WORD
+                       : (((map_word) 1 << n) - 1) << ofs);
+
+      store_word (w, value ? free_map[w] | mask : free_map[w] & ~mask);
+      bitmap_mark (dirty_chunks, w / CHUNK_WORDS);
+
+      sector += n;
+      cnt -= n;
+    }
+}
+
+/* Returns true if all of the CNT sectors starting at SECTOR are
+   in use. */
+static bool
+all_in_use (size_t sector, size_t cnt)
+{
+  for (; cnt > 0; sector++, cnt--)
+    if (!test_sector (sector))
+      return false;
+  return true;
+}
+
+/* Returns the index of the first word of the free map at or
+   after word FIRST and before word LAST that has a free sector,
+   or LAST if there is none. */
+static size_t
+find_free_word (size_t first, size_t last)
+{
+  size_t w = first;
+
+  while (w < last)
+    {
+      map_word s = summary[w / WORD_BITS] | (((map_word) 1 << (w % WORD_BITS)) - 1);
+      if (s != FULL_WORD)
+        {
+          w = w / WORD_BITS * WORD_BITS + first_clear (s);
+          return w < last ? w : last;
+        }
+      w = ROUND_UP (w + 1, WORD_BITS);
+    }
+  return last;
+}
+
+/* Returns the first sector of a run of CNT free sectors that
+   starts in a word at or after word FIRST and ends before word
+   LAST, or BITMAP_ERROR if there is none.  Words with no free
+   sectors are skipped through the summary, and words with no
+   sectors in use are taken whole. */
+static size_t
+find_run (size_t cnt, size_t first, size_t last)
+{
+  size_t run_start = 0;
+  size_t run_len = 0;
+  size_t w = first;
+
+  while (w < last)
+    {
+      map_word word = free_map[w];
+
+      if (word == FULL_WORD)
+        {
+          size_t next = find_free_word (w + 1, last);
+          run_len = 0;
+          w = next;
+          continue;
+        }
+
+      if (word == 0)
+        {
+          if (run_len == 0)
+            run_start = w * WORD_BITS;
+          run_len += WORD_BITS;
+        }
+      else
+        {
+          unsigned bit;
+
+          for (bit = 0; bit < WORD_BITS && run_len < cnt; bit++)
+            if (word & ((map_word) 1 << bit))
+              run_len = 0;
+            else if (run_len++ == 0)
+              run_start = w * WORD_BITS + bit;
+        }
+      if (run_len >= cnt)
+        return run_start + cnt <= sector_cnt ? run_start : BITMAP_ERROR;
+      w++;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Finds a run of CNT free sectors, searching from word FIRST to
+   the end of the disk and then from the start.  Returns its
+   first sector, or BITMAP_ERROR if there is none. */
+static size_t
+find_run_wrapping (size_t cnt, size_t first)
+{
+  size_t sector = find_run (cnt, first, map_words);
+  if (sector == BITMAP_ERROR && first > 0)
+    {
+      /* Runs may straddle FIRST. */
+      size_t last = first + DIV_ROUND_UP (cnt, WORD_BITS) + 1;
+      sector = find_run (cnt, 0, last < map_words ? last : map_words);
+    }
+  return sector;
+}
+
+/* Returns the first free sector at or after GOAL, wrapping
+   around to the start of the disk, or BITMAP_ERROR if the disk
+   is full. */
+static size_t
+find_free_sector (size_t goal)
+{
+  size_t first = goal / WORD_BITS;
+  map_word word = free_map[first] | (((map_word) 1 << (goal % WORD_BITS)) - 1);
+  size_t w;
+
+  if (word != FULL_WORD)
+    return first * WORD_BITS + first_clear (word);
+  w = find_free_word (first + 1, map_words);
+  if (w == map_words)
+    {
+      /* Sectors before GOAL in its own word count too. */
+      w = find_free_word (0, first + 1);
+      if (w == first + 1)
+        return BITMAP_ERROR;
+    }
+  return w * WORD_BITS + first_clear (free_map[w]);
+}
 
 /* Initializes the free map. */
 void
 free_map_init (void)
 {
+  size_t w;
+
   lock_init (&free_map_lock);
+  lock_init (&flush_lock);
+
+  sector_cnt = block_size (fs_device);
+  map_words = DIV_ROUND_UP (sector_cnt, WORD_BITS);
+  summary_words = DIV_ROUND_UP (map_words, WORD_BITS);
+  group_cnt = DIV_ROUND_UP (map_words, GROUP_WORDS);
+  free_map = calloc (map_words, sizeof *free_map);
+  summary = calloc (summary_words, sizeof *summary);
+  deferred = calloc (map_words, sizeof *deferred);
+  reserved = calloc (map_words, sizeof *reserved);
+  group_used = calloc (group_cnt, sizeof *group_used);
+  dirty_chunks = bitmap_create (DIV_ROUND_UP (map_words, CHUNK_WORDS));
+  if (free_map == NULL || summary == NULL || deferred == NULL
+      || reserved == NULL || group_used == NULL || dirty_chunks == NULL)
+    PANIC ("free map creation failed--file system device is too large");
+  any_deferred = false;
 
-  free_map = bitmap_create (block_size (fs_device));
-  if (free_map == NULL)
-    PANIC ("bitmap creation failed--file system device is too large");
-  bitmap_mark (free_map, FREE_MAP_SECTOR);
-  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  /* Sectors past the end of the disk in the last word, and words
+     past the end of the map in the last summary word, never
+     become free. */
+  set_sectors (sector_cnt, map_words * WORD_BITS - sector_cnt, true);
+  for (w = map_words; w < summary_words * WORD_BITS; w++)
+    summary[w / WORD_BITS] |= (map_word) 1 << (w % WORD_BITS);
+
+  set_sectors (FREE_MAP_SECTOR, 1, true);
+  set_sectors (ROOT_DIR_SECTOR, 1, true);
+  set_sectors (JOURNAL_SECTOR, 1, true);
+}
+
+/* Frees the CNT sectors starting at SECTOR, except that those
+   in the journal are only marked in DEFERRED. */
+static void
+release (size_t sector, size_t cnt)
+{
+  size_t end = sector + cnt;
+  size_t start = sector;
+
+  for (; sector < end; sector++)
+    if (journal_logged (sector))
+      {
+        set_sectors (start, sector - start, false);
+        deferred[sector / WORD_BITS] |= (map_word) 1 << (sector % WORD_BITS);
+        bitmap_mark (dirty_chunks, sector / WORD_BITS / CHUNK_WORDS);
+        any_deferred = true;
+        start = sector + 1;
+      }
+  set_sectors (start, end - start, false);
 }
 
-/* Allocates a sector from the free map and stores it into
-   *SECTORP.
-   Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
-   written. */
+/* Allocates the first free sector at or after GOAL, or failing
+   that the first free sector on the disk, and stores it into
+   *SECTORP.  Returns true if successful, false if the disk is
+   full. */
 bool
-free_map_allocate (block_sector_t *sectorp)
+free_map_allocate_near (block_sector_t goal, block_sector_t *sectorp)
 {
   size_t sector;
 
   lock_acquire (&free_map_lock);
-  sector = bitmap_scan_and_flip (free_map, 0, 1, false);
+  sector = find_free_sector (goal < sector_cnt ? goal : 0);
+  if (sector != BITMAP_ERROR)
+    set_sectors (sector, 1, true);
   lock_release (&free_map_lock);
 
-  if (sector != BITMAP_ERROR)
-    *sectorp = sector;
-  return sector != BITMAP_ERROR;
+  if (sector == BITMAP_ERROR)
+    return false;
+  *sectorp = sector;
+  return true;
+}
+
+/* Returns the first sector of the allocation group that a new
+   directory under the directory whose inode is in sector PARENT
+   should go in: the group with the most free sectors.  Among
+   equally free groups, the first one after PARENT's is chosen,
+   so that sibling directories spread out over the disk. */
+block_sector_t
+free_map_dir_goal (block_sector_t parent)
+{
+  size_t first = parent / GROUP_SECTORS;
+  size_t best = first;
+  size_t best_free = 0;
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  for (i = 1; i <= group_cnt; i++)
+    {
+      size_t g = (first + i) % group_cnt;
+      size_t size = (g + 1 < group_cnt
+                     ? GROUP_SECTORS
+                     : (map_words - g * GROUP_WORDS) * WORD_BITS);
+      size_t avail = size - group_used[g];
+      if (avail > best_free)
+        {
+          best = g;
+          best_free = avail;
+        }
+    }
+  lock_release (&free_map_lock);
+
+  return best * GROUP_SECTORS;
 }
 
 /* Makes SECTOR available for use. */
@@ -68,11 +383,260 @@ void
 free_map_release (block_sector_t sector)
 {
   lock_acquire (&free_map_lock);
-  ASSERT (bitmap_test (free_map, sector));
-  bitmap_reset (free_map, sector);
+  ASSERT (test_sector (sector));
+  release (sector, 1);
   lock_release (&free_map_lock);
 }
 
+/* Allocates a run of up to CNT consecutive sectors, as
+   described for free_map_allocate_run().  free_map_lock must be
+   held. */
+static size_t
+allocate_run (size_t cnt, size_t slack, block_sector_t goal,
+              block_sector_t *sectorp)
+{
+  size_t sector = BITMAP_ERROR;
+  size_t want;
+
+  ASSERT (cnt > 0);
+  ASSERT (lock_held_by_current_thread (&free_map_lock));
+
+  for (want = cnt + slack; want > 0; want /= 2)
+    {
+      sector = find_run_wrapping (want, goal < sector_cnt ? goal / WORD_BITS : 0);
+      if (sector != BITMAP_ERROR)
+        break;
+    }
+  if (sector == BITMAP_ERROR)
+    return 0;
+  if (cnt > want)
+    cnt = want;
+  set_sectors (sector, cnt, true);
+  *sectorp = sector;
+  return cnt;
+}
+
+/* Allocates a run of up to CNT consecutive sectors and stores
+   the first into *SECTORP.  The run is placed where SLACK more
+   free sectors follow it, so that it can later be grown in place
+   with free_map_allocate_at(), searching from GOAL onward.  If
+   there is no such place, successively shorter runs are tried.
+   Returns the number of sectors allocated, or 0 if the disk is
+   full. */
+size_t
+free_map_allocate_run (size_t cnt, size_t slack, block_sector_t goal,
+                       block_sector_t *sectorp)
+{
+  lock_acquire (&free_map_lock);
+  cnt = allocate_run (cnt, slack, goal, sectorp);
+  lock_release (&free_map_lock);
+
+  return cnt;
+}
+
+/* Reserves a run of up to CNT consecutive sectors, searching
+   from GOAL onward, and stores the first into *SECTORP.  The
+   sectors cannot be allocated by anyone else, but are not in use
+   on disk until claimed with free_map_claim(), and are not
+   zeroed.  Returns the number of sectors reserved, or 0 if the
+   disk is full. */
+size_t
+free_map_reserve (size_t cnt, block_sector_t goal, block_sector_t *sectorp)
+{
+  size_t i;
+
+  lock_acquire (&free_map_lock);
+  cnt = allocate_run (cnt, 0, goal, sectorp);
+  for (i = 0; i < cnt; i++)
+    {
+      size_t sector = *sectorp + i;
+      reserved[sector / WORD_BITS] |= (map_word) 1 << (sector % WORD_BITS);
+    }
+  lock_release (&free_map_lock);
+
+  return cnt;
+}
+
+/* Puts SECTOR, which must have been reserved with
+   free_map_reserve() and not claimed yet, in use. */
+void
+free_map_claim (block_sector_t sector)
+{
+  map_word mask = (map_word) 1 << (sector % WORD_BITS);
+
+  lock_acquire (&free_map_lock);
+  ASSERT (reserved[sector / WORD_BITS] & mask);
+  reserved[sector / WORD_BITS] &= ~mask;
+  bitmap_mark (dirty_chunks, sector / WORD_BITS / CHUNK_WORDS);
+  lock_release (&free_map_lock);
+}
+
+/* Returns SECTOR, claimed with free_map_claim() but not used
+   after all, to the reservation it was claimed from. */
+void
+free_map_unclaim (block_sector_t sector)
+{
+  map_word mask = (map_word) 1 << (sector % WORD_BITS);
+
+  lock_acquire (&free_map_lock);
+  ASSERT (test_sector (sector));
+  ASSERT (!(reserved[sector / WORD_BITS] & mask));
+  reserved[sector / WORD_BITS] |= mask;
+  bitmap_mark (dirty_chunks, sector / WORD_BITS / CHUNK_WORDS);
+  lock_release (&free_map_lock);
+}
+
+/* Frees the sectors among the CNT starting at SECTOR that are
+   still reserved.  Claimed ones stay in use. */
+void
+free_map_unreserve (block_sector_t sector, size_t cnt)
+{
+  size_t end = sector + cnt;
+
+  lock_acquire (&free_map_lock);
+  for (; sector < end; sector++)
+    {
+      map_word mask = (map_word) 1 << (sector % WORD_BITS);
+      if (reserved[sector / WORD_BITS] & mask)
+        {
+          reserved[sector / WORD_BITS] &= ~mask;
+          set_sectors (sector, 1, false);
+        }
+    }
+  lock_release (&free_map_lock);
+}
+
+/* Allocates up to CNT consecutive sectors starting exactly at
+   SECTOR, stopping at the first sector already in use or at the
+   end of the disk.  Returns the number of sectors allocated,
+   which may be 0. */
+size_t
+free_map_allocate_at (block_sector_t sector, size_t cnt)
+{
+  size_t n = 0;
+
+  lock_acquire (&free_map_lock);
+  while (n < cnt && sector + n < sector_cnt && !test_sector (sector + n))
+    n++;
+  if (n > 0)
+    set_sectors (sector, n, true);
+  lock_release (&free_map_lock);
+
+  return n;
+}
+
+/* Makes the CNT sectors starting at SECTOR available for use. */
+void
+free_map_release_run (block_sector_t sector, size_t cnt)
+{
+  lock_acquire (&free_map_lock);
+  ASSERT (all_in_use (sector, cnt));
+  release (sector, cnt);
+  lock_release (&free_map_lock);
+}
+
+/* Makes the sectors whose release was put off by the journal
+   available for use.  Called once the journal no longer refers
+   to them. */
+void
+free_map_release_deferred (void)
+{
+  size_t w;
+
+  lock_acquire (&free_map_lock);
+  for (w = 0; any_deferred && w < map_words; w++)
+    if (deferred[w] != 0)
+      {
+        store_word (w, free_map[w] & ~deferred[w]);
+        deferred[w] = 0;
+      }
+  any_deferred = false;
+  lock_release (&free_map_lock);
+}
+
+/* Reads the free map from the free map file. */
+static bool
+read_map (void)
+{
+  off_t size = map_words * sizeof *free_map;
+  size_t w;
+
+  if (file_read_at (free_map_file, free_map, size, 0) != size)
+    return false;
+  memset (group_used, 0, group_cnt * sizeof *group_used);
+  for (w = 0; w < map_words; w++)
+    {
+      group_used[w / GROUP_WORDS] += count_bits (free_map[w]);
+      update_summary (w);
+    }
+  set_sectors (sector_cnt, map_words * WORD_BITS - sector_cnt, true);
+  bitmap_set_all (dirty_chunks, false);
+  return true;
+}
+
+/* Writes the free map to the free map file. */
+static bool
+write_map (void)
+{
+  off_t size = map_words * sizeof *free_map;
+  if (file_write_at (free_map_file, free_map, size, 0) != size)
+    return false;
+  bitmap_set_all (dirty_chunks, false);
+  return true;
+}
+
+/* Writes the chunks of the free map that changed since they were
+   last written into the free map file.  The writes go through
+   the buffer cache, so they reach the disk with the next cache
+   flush.  Does nothing if the free map file is not open. */
+void
+free_map_flush (void)
+{
+  size_t chunk_cnt;
+  size_t chunk;
+
+  /* The flush thread may run before the free map is opened. */
+  if (free_map_file == NULL)
+    return;
+
+  chunk_cnt = bitmap_size (dirty_chunks);
+  lock_acquire (&flush_lock);
+  if (free_map_file == NULL)
+    {
+      lock_release (&flush_lock);
+      return;
+    }
+  for (chunk = 0; chunk < chunk_cnt; chunk++)
+    {
+      map_word buffer[CHUNK_WORDS];
+      size_t first = chunk * CHUNK_WORDS;
+      size_t cnt = map_words - first < CHUNK_WORDS ? map_words - first
+                                                   : CHUNK_WORDS;
+      off_t size = cnt * sizeof *free_map;
+      size_t i;
+
+      /* Copy the chunk out under the lock, so that allocations are
+         not held up by the write.  A chunk changed after the copy
+         is marked dirty again and written by the next flush. */
+      lock_acquire (&free_map_lock);
+      if (!bitmap_test (dirty_chunks, chunk))
+        {
+          lock_release (&free_map_lock);
+          continue;
+        }
+      for (i = 0; i < cnt; i++)
+        buffer[i] = (free_map[first + i] & ~deferred[first + i]
+                     & ~reserved[first + i]);
+      bitmap_reset (dirty_chunks, chunk);
+      lock_release (&free_map_lock);
+
+      if (file_write_at (free_map_file, buffer, size,
+                         first * sizeof *free_map) != size)
+        PANIC ("can't write free map");
+    }
+  lock_release (&flush_lock);
+}
+
 /* Opens the free map file and reads it from disk. */
 void
 free_map_open (void)
@@ -80,17 +644,20 @@ free_map_open (void)
   free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
-  if (!bitmap_read (free_map, free_map_file))
+  if (!read_map ())
     PANIC ("can't read free map");
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Writes the changed chunks of the free map to disk and closes
+   the free map file. */
 void
 free_map_close (void)
 {
-  if (!bitmap_write (free_map, free_map_file))
-    PANIC ("can't write free map");
+  free_map_flush ();
+  lock_acquire (&flush_lock);
   file_close (free_map_file);
+  free_map_file = NULL;
+  lock_release (&flush_lock);
 }
 
 /* Creates a new free map file on disk and writes the free map to
@@ -114,7 +681,7 @@ free_map_create (void)
   printf("free-map.c, before file_open.\n");
   struct inode * inode1 = inode_open (FREE_MAP_SECTOR);
   printf("FREE_MAP_SECTOR is %d.\n", FREE_MAP_SECTOR);
-  printf("inode1's sector # is: %d.\n", inode1->sector);
+  printf("inode1's sector # is: %d.\n", inode_get_inumber (inode1));
   
   free_map_file = file_open (inode1);
   printf("free-map.c, after file_open.\n");
@@ -122,7 +689,7 @@ free_map_create (void)
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   printf("free_map_file is not NULL. \n");
-  if (!bitmap_write (free_map, free_map_file)){
+  if (!write_map ()){
     PANIC ("can't write free map");
   }
     
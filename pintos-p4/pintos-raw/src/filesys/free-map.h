@@ -11,8 +11,20 @@ void free_map_read (void);
 void free_map_create (void);
 void free_map_open (void);
 void free_map_close (void);
+void free_map_flush (void);
 
-bool free_map_allocate (block_sector_t *);
+bool free_map_allocate_near (block_sector_t goal, block_sector_t *);
+block_sector_t free_map_dir_goal (block_sector_t parent);
 void free_map_release (block_sector_t);
+size_t free_map_allocate_run (size_t cnt, size_t slack, block_sector_t goal,
+                              block_sector_t *);
+size_t free_map_allocate_at (block_sector_t, size_t cnt);
+void free_map_release_run (block_sector_t, size_t cnt);
+void free_map_release_deferred (void);
+
+size_t free_map_reserve (size_t cnt, block_sector_t goal, block_sector_t *);
+void free_map_claim (block_sector_t);
+void free_map_unclaim (block_sector_t);
+void free_map_unreserve (block_sector_t, size_t cnt);
 
 #endif /* filesys/free-map.h */
@@ -1,20 +1,31 @@
 #include "filesys/inode.h"
 #include <bitmap.h>
+#include <hash.h>
 #include <list.h>
 #include <debug.h>
 #include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "filesys/cache.h"
+#include "filesys/dentry.h"
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
 #include "threads/synch.h"
+#include "threads/thread.h"
 
 #include "userprog/syscall.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
 
+/* Identifies an inode that maps its data with extents. */
+#define EXTENT_MAGIC 0x45585444
+
+/* Identifies an inode that keeps its data in the inode sector. */
+#define INLINE_MAGIC 0x494e4c4e
+
 #define DIRECT_CNT 123
 #define INDIRECT_CNT 1
 #define DBL_INDIRECT_CNT 1
@@ -28,6 +39,27 @@
                      + PTRS_PER_SECTOR * PTRS_PER_SECTOR * DBL_INDIRECT_CNT) \
                     * BLOCK_SECTOR_SIZE)
 
+/* A run of LENGTH consecutive sectors starting at START, or a
+   hole of LENGTH unwritten sectors if START is 0. */
+struct extent
+  {
+    block_sector_t start;               /* First sector. */
+    uint32_t length;                    /* Number of sectors, 0 if unused. */
+  };
+
+//62 extents fit in the space of the block map.
+#define EXTENT_CNT (SECTOR_CNT * sizeof (block_sector_t) / sizeof (struct extent))
+
+//files up to 500 bytes fit there too, and need no data sectors.
+#define INLINE_MAX ((off_t) (SECTOR_CNT * sizeof (block_sector_t)))
+
+/* Returns true if EXTENT is a hole: sectors that belong to the
+   file but have never been written, and read as zeros. */
+static inline bool
+is_hole (const struct extent *extent)
+{
+  return extent->start == 0;
+}
 
 
 static void deallocate_inode (const struct inode *inode);
@@ -36,7 +68,12 @@ static void deallocate_inode (const struct inode *inode);
    Must be exactly BLOCK_SECTOR_SIZE bytes long. */
 struct inode_disk
   {
-    block_sector_t sectors[SECTOR_CNT]; /* Sectors. */
+    union
+      {
+        block_sector_t sectors[SECTOR_CNT];   /* Sectors, if INODE_MAGIC. */
+        struct extent extents[EXTENT_CNT];    /* Extents, if EXTENT_MAGIC. */
+        uint8_t inline_data[INLINE_MAX];      /* Data, if INLINE_MAGIC. */
+      };
     enum inode_type type;               /* FILE_INODE or DIR_INODE. */
     off_t length;                       /* File size in bytes. */
     unsigned magic;                     /* Magic number. */
@@ -50,13 +87,21 @@ bytes_to_sectors (off_t size)
 return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
 }
 
+/* The part of an inode that open_inodes hashes and compares, so
+   that a lookup needs only this much of one as its key. */
+struct inode_key
+  {
+    struct hash_elem elem;              /* Element in open_inodes. */
+    block_sector_t sector;              /* Sector number of disk location. */
+  };
+
 /* In-memory inode. */
 struct inode 
   {
-    //if not opened, not used yet since not in open_inodes list. 
-    struct list_elem elem;              /* Element in inode list. */
+    //if not opened, not used yet since not in open_inodes table. 
     //sector will be used to locate inode disk
-    block_sector_t sector;              /* Sector number of disk location. */
+    struct inode_key key;               /* Element in open_inodes. */
+    struct list_elem reclaim_elem;      /* Element in reclaim_list. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     //no two threads can modify an inode at the same time. 
@@ -67,22 +112,117 @@ struct inode
     struct condition no_writers_cond;   /* Signaled when no writers. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
     int writer_cnt;                     /* Number of writers. */
+
+    /* Reader/writer lock on the file's bytes.  Reads share it;
+       writes to bytes before end of file hold it alone, so a
+       read sees all of such a write or none of it. */
+    struct rwlock rw_lock;
+
+    /* Held while the file grows, by writes past end of file and
+       by inode_extend() and inode_reserve().  The length changes
+       only after the new bytes are in place, and readers stop at
+       the old length, so they need not wait for such writes. */
+    struct lock extend_lock;
+
+    /* Resident copy of the on-disk inode.
+       inode_lock() is held by directory code across reads and
+       writes, so the copy needs a lock of its own. */
+    struct lock disk_lock;              /* Protects members below. */
+    struct inode_disk data;             /* Copy of the on-disk inode. */
+    bool dirty;                         /* DATA differs from disk? */
+    block_sector_t last_block;          /* Last sector allocated for it. */
+
+    /* Sectors reserved by inode_reserve() for file sectors
+       RESERVE_IDX onward, taken as those are first written. */
+    block_sector_t reserve_start;       /* First reserved sector. */
+    size_t reserve_idx;                 /* File sector it is for. */
+    size_t reserve_cnt;                 /* Number reserved, 0 if none. */
   };
 
-/* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
-static struct list open_inodes;
+/* Open inodes, keyed by sector, so that opening a single inode
+   twice returns the same `struct inode'. */
+static struct hash open_inodes;
 
-/* Controls access to open_inodes list. */
+/* Controls access to open_inodes table. */
 static struct lock open_inodes_lock;
 
+static hash_hash_func inode_hash;
+static hash_less_func inode_less;
+
+/* Removed inodes whose sectors the reclaim thread has yet to
+   free.  Their memory stays allocated until then. */
+static struct list reclaim_list;
+static struct lock reclaim_lock;        /* Protects reclaim_list. */
+static struct condition reclaim_cond;   /* Signaled when nonempty. */
+
+/* Serializes freeing sectors, which uses the static buffers
+   below.  Acquired inside a journal handle. */
+static struct lock reclaim_work_lock;
+
+static thread_func reclaim_daemon NO_RETURN;
+
+/* Layout given to newly created inodes.
+   Chosen when the file system is formatted. */
+static enum inode_layout new_inode_layout = LAYOUT_BLOCK_MAP;
+
 /* Initializes the inode module. */
 //DONE.
 void
 inode_init (void) 
 {
-  list_init (&open_inodes);
+  if (!hash_init (&open_inodes, inode_hash, inode_less, NULL))
+    PANIC ("couldn't allocate open inode table");
   lock_init (&open_inodes_lock);
+
+  list_init (&reclaim_list);
+  lock_init (&reclaim_lock);
+  cond_init (&reclaim_cond);
+  lock_init (&reclaim_work_lock);
+  thread_create ("reclaim", PRI_DEFAULT, reclaim_daemon, NULL);
+}
+
+/* Returns a hash value for the inode key containing E. */
+static unsigned
+inode_hash (const struct hash_elem *e, void *aux UNUSED)
+{
+  const struct inode_key *key = hash_entry (e, struct inode_key, elem);
+  return hash_int (key->sector);
+}
+
+/* Returns true if the inode key containing A has a lower sector
+   than the one containing B. */
+static bool
+inode_less (const struct hash_elem *a, const struct hash_elem *b,
+            void *aux UNUSED)
+{
+  return (hash_entry (a, struct inode_key, elem)->sector
+          < hash_entry (b, struct inode_key, elem)->sector);
+}
+
+/* Makes inodes created from now on use LAYOUT. */
+void
+inode_set_layout (enum inode_layout layout)
+{
+  new_inode_layout = layout;
+}
+
+/* Returns the magic number of inodes that use the layout chosen
+   when the file system was formatted. */
+static unsigned
+layout_magic (void)
+{
+  return new_inode_layout == LAYOUT_EXTENTS ? EXTENT_MAGIC : INODE_MAGIC;
+}
+
+/* Returns the layout INODE uses to map its data.  An inode whose
+   data is still inline will use the file system's layout once
+   it outgrows the inode sector. */
+enum inode_layout
+inode_get_layout (const struct inode *inode)
+{
+  if (inode->data.magic == INLINE_MAGIC)
+    return new_inode_layout;
+  return inode->data.magic == EXTENT_MAGIC ? LAYOUT_EXTENTS : LAYOUT_BLOCK_MAP;
 }
 
 
@@ -107,11 +247,13 @@ inode_create(block_sector_t sector, enum inode_type type) {
   }
   
   disk_inode->type = type;
-  disk_inode->magic = INODE_MAGIC;
+  // small files live in the inode sector until they outgrow it.
+  // directories are written a whole bucket at a time, so they never fit.
+  disk_inode->magic = type == FILE_INODE ? INLINE_MAGIC : layout_magic();
   disk_inode->length = 0;
   //the rest are zeros. 
 
-  block_write(fs_device, sector, disk_inode);
+  cache_write_meta(sector, disk_inode);
 
   struct inode *mem_inode = inode_open(sector);
 
@@ -155,15 +297,12 @@ struct inode *inode_open(block_sector_t sector) {
 /* Searches for an open inode with the specified sector.
    Returns the inode if found, otherwise NULL. */
 static struct inode *find_open_inode(block_sector_t sector) {
-  struct list_elem *e;
-  for (e = list_begin(&open_inodes); e != list_end(&open_inodes);
-       e = list_next(e)) {
-    struct inode *inode = list_entry(e, struct inode, elem);
-    if (inode->sector == sector) {
-      return inode;
-    }
-  }
-  return NULL;
+  struct inode_key key;
+  struct hash_elem *e;
+
+  key.sector = sector;
+  e = hash_find(&open_inodes, &key.elem);
+  return e != NULL ? hash_entry(e, struct inode, key.elem) : NULL;
 }
 
 /* Creates a new inode for the specified sector.
@@ -176,7 +315,7 @@ static struct inode *create_new_inode(block_sector_t sector) {
   }
 
   // Initialize the new inode
-  inode->sector = sector;
+  inode->key.sector = sector;
   inode->open_cnt = 1;
   inode->removed = false;
   lock_init(&inode->lock);
@@ -184,11 +323,47 @@ static struct inode *create_new_inode(block_sector_t sector) {
   cond_init(&inode->no_writers_cond);
   inode->deny_write_cnt = 0;
   inode->writer_cnt = 0;
-  list_push_front(&open_inodes, &inode->elem);
+  rwlock_init(&inode->rw_lock);
+  lock_init(&inode->extend_lock);
+
+  // Load the on-disk inode once; it stays resident until the last close
+  lock_init(&inode->disk_lock);
+  cache_read(sector, &inode->data);
+  inode->dirty = false;
+  // until it allocates a block, new blocks go right after the inode
+  inode->last_block = sector;
+  inode->reserve_cnt = 0;
+  hash_insert(&open_inodes, &inode->key.elem);
 
   return inode;
 }
 
+/* Writes INODE's resident on-disk inode back to its sector if
+   it has been modified.  INODE's disk_lock must be held. */
+static void
+inode_writeback (struct inode *inode)
+{
+  ASSERT (lock_held_by_current_thread (&inode->disk_lock));
+
+  if (inode->dirty)
+    {
+      cache_write_meta (inode->key.sector, &inode->data);
+      inode->dirty = false;
+    }
+}
+
+/* Frees the sectors reserved for INODE by inode_reserve() that
+   were not written. */
+static void
+release_reservation (struct inode *inode)
+{
+  if (inode->reserve_cnt > 0)
+    {
+      free_map_unreserve (inode->reserve_start, inode->reserve_cnt);
+      inode->reserve_cnt = 0;
+    }
+}
+
 /* Reopens and returns INODE. */
 //DONE.
 struct inode *
@@ -208,16 +383,8 @@ inode_reopen (struct inode *inode)
 //DONE.
 enum inode_type inode_get_type(const struct inode *inode) {
   ASSERT(inode != NULL);
-  enum inode_type type;
-  // Allocate space for disk_inode
-  struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
-  // Read the inode_disk data from the inode
-  block_read(fs_device, inode->sector, disk_inode);
-  // Retrieve the type from the inode_disk
-  type = disk_inode->type;
-  // Free the allocated memory
-  free(disk_inode);
-  return type;
+  // The type never changes after inode_create, so no lock is needed
+  return inode->data.type;
 }
 
 
@@ -226,105 +393,183 @@ enum inode_type inode_get_type(const struct inode *inode) {
 block_sector_t
 inode_get_inumber (const struct inode *inode)
 {
-  return inode->sector;
+  return inode->key.sector;
 }
 
 /* Closes INODE and writes it to disk.
    If this was the last reference to INODE, frees its memory.
-   If INODE was also a removed inode, frees its blocks. */
+   If INODE was also a removed inode, hands it to the reclaim
+   thread, which frees its blocks and then its memory. */
 void inode_close(struct inode *inode) {
   if(inode == NULL){return;}
 
+  // Writing back the inode updates metadata. The handle is opened
+  // before taking any lock, since it may wait for a commit.
+  bool journaled = inode->dirty;
+  if(journaled){journal_begin();}
+
   lock_acquire(&open_inodes_lock);
   inode->open_cnt -= 1;
   if(inode->open_cnt > 0){
     lock_release(&open_inodes_lock);
+  }else if(inode->removed == true){
+    hash_delete(&open_inodes, &inode->key.elem);
+    lock_release(&open_inodes_lock);
+    release_reservation(inode);
+
+    // Freeing a big file's sectors takes a while; don't make the
+    // caller (or anyone waiting on open_inodes_lock) wait for it.
+    lock_acquire(&reclaim_lock);
+    list_push_back(&reclaim_list, &inode->reclaim_elem);
+    cond_signal(&reclaim_cond, &reclaim_lock);
+    lock_release(&reclaim_lock);
   }else{
-    list_remove(&inode->elem);
-    if(inode->removed == true){
-      deallocate_inode(inode);
-    }
+    hash_delete(&open_inodes, &inode->key.elem);
+    lock_acquire(&inode->disk_lock);
+    release_reservation(inode);
+    inode_writeback(inode);
+    lock_release(&inode->disk_lock);
     lock_release(&open_inodes_lock);
     free(inode);
   }
+  if(journaled){journal_end();}
+}
+
+
+/* Sectors waiting to be freed. Consecutive sectors are released
+   together with free_map_release_run(). */
+#define RELEASE_BATCH_CNT 128
+static block_sector_t release_batch[RELEASE_BATCH_CNT];
+static size_t release_cnt;
 
+/* Frees the sectors in release_batch. */
+static void flush_release_batch(void) {
+  size_t i = 0;
+  while (i < release_cnt){
+    size_t j = i + 1;
+    while (j < release_cnt && release_batch[j] == release_batch[j - 1] + 1){
+      j++;
+    }
+    free_map_release_run(release_batch[i], j - i);
+    i = j;
+  }
+  release_cnt = 0;
+}
+
+/* Adds SECTOR to the sectors waiting to be freed. */
+static void release_sector(block_sector_t sector) {
+  if (release_cnt == RELEASE_BATCH_CNT){
+    flush_release_batch();
+  }
+  release_batch[release_cnt++] = sector;
 }
 
 
 /* Deallocates SECTOR and anything it points to recursively.
    LEVEL is 2 if SECTOR is doubly indirect,
    or 1 if SECTOR is indirect,
-   or 0 if SECTOR is a data sector. */
+   or 0 if SECTOR is a data sector.
+   reclaim_work_lock must be held. */
 //DONE
 static void deallocate_recursive(block_sector_t sector, int level) {
-  if (level == 2){
-    //assign space
-    uint32_t* doubly_indirect_map = malloc(BLOCK_SECTOR_SIZE);
-    if(doubly_indirect_map == NULL) return;
-    block_read (fs_device, sector, doubly_indirect_map);
+  // one indirect block per level, so no allocation is needed
+  static block_sector_t maps[2][PTRS_PER_SECTOR];
 
+  if (sector == 0){
+    // nothing was ever allocated here
+    return;
+  }
+  if (level > 0){
+    block_sector_t *map = maps[level - 1];
+    cache_read (sector, map);
+    // holes leave zero pointers in the middle, so skip rather than stop
     for (int i=0; i<PTRS_PER_SECTOR; i++){
-      if (doubly_indirect_map[i]==0) break;
-      // not zero, we do have an indirect map
-      uint32_t* indirect_map = malloc(BLOCK_SECTOR_SIZE);
-      block_read (fs_device, doubly_indirect_map[i], indirect_map);
-
-      // about to enter into the indirect map.
-      for (int j=0; j<PTRS_PER_SECTOR; j++){
-        if (indirect_map[j]==0) {break;}
-        // not zero, there is a sector. 
-        free_map_release (indirect_map[j]);
-      }
-
-      free_map_release (doubly_indirect_map[i]);
-      //finished using it, free the map. 
-      free(indirect_map);
-    }
-    free_map_release (sector);
-    //finished using the doubly_indirect_map. 
-    free(doubly_indirect_map);
-  }else if (level == 1){
-    uint32_t* indirect_map = malloc(BLOCK_SECTOR_SIZE);
-    block_read (fs_device, sector, indirect_map);
-    // remember to zero out the sectors before using it leter. 
-    for (int i=0; i<PTRS_PER_SECTOR; i++){
-      if (indirect_map[i]==0) break;
-      free_map_release (indirect_map[i]);
-     
+      deallocate_recursive(map[i], level - 1);
     }
-    free_map_release (sector);
-    //free the indirect_map after using it. 
-    free(indirect_map);
-  }else if (level == 0){
-    // regular data sector
-    free_map_release (sector);
   }
+  release_sector (sector);
 }
 
 
-/* Deallocates the blocks allocated for INODE. */
+/* Deallocates the blocks allocated for INODE.
+   reclaim_work_lock must be held. */
 //DONE
 static void
 deallocate_inode (const struct inode *inode)
 {
   /// deallocate recursive ..
-  // mainly go check the on disk things. 
-  struct inode_disk *buffer = calloc(1, sizeof *buffer);
-  block_read (fs_device, inode->sector, buffer);
-  for (int i=0; i<DIRECT_CNT; i++){
-    //if nothing there assigned, just return. 
-    if (buffer->sectors[i]==0) {
-      free (buffer);
-      return;
+  // the resident copy is the authoritative sector map.
+  const struct inode_disk *disk_inode = &inode->data;
+  if (disk_inode->magic == INLINE_MAGIC){
+    free_map_release (inode->key.sector);
+    return;
+  }
+  if (disk_inode->magic == EXTENT_MAGIC){
+    for (size_t i=0; i<EXTENT_CNT && disk_inode->extents[i].length > 0; i++){
+      if (!is_hole (&disk_inode->extents[i])){
+        free_map_release_run (disk_inode->extents[i].start, disk_inode->extents[i].length);
+      }
     }
-    deallocate_recursive(buffer->sectors[i], 0);
-    // set back to zero. 
-    buffer->sectors[i] = 0;
+    free_map_release (inode->key.sector);
+    return;
   }
-  deallocate_recursive(buffer->sectors[DIRECT_CNT],1);
-  deallocate_recursive(buffer->sectors[DIRECT_CNT+1],2);
-  free_map_release (inode->sector);
-  free (buffer);
+  for (int i=0; i<DIRECT_CNT; i++){
+    deallocate_recursive(disk_inode->sectors[i], 0);
+  }
+  deallocate_recursive(disk_inode->sectors[DIRECT_CNT],1);
+  deallocate_recursive(disk_inode->sectors[DIRECT_CNT+1],2);
+  flush_release_batch();
+  free_map_release (inode->key.sector);
+}
+
+/* Frees the sectors of every removed inode waiting for the
+   reclaim thread, and then the inodes themselves.
+   Returns true if there were any. */
+bool
+inode_reclaim (void)
+{
+  struct list pending;
+
+  list_init (&pending);
+  journal_begin ();
+  lock_acquire (&reclaim_work_lock);
+
+  lock_acquire (&reclaim_lock);
+  while (!list_empty (&reclaim_list))
+    list_push_back (&pending, list_pop_front (&reclaim_list));
+  lock_release (&reclaim_lock);
+
+  bool any = !list_empty (&pending);
+  while (!list_empty (&pending))
+    {
+      struct inode *inode = list_entry (list_pop_front (&pending),
+                                        struct inode, reclaim_elem);
+      /* The sector may come back as another directory. */
+      if (inode->data.type == DIR_INODE)
+        dentry_invalidate_dir (inode->key.sector);
+      deallocate_inode (inode);
+      free (inode);
+    }
+
+  lock_release (&reclaim_work_lock);
+  journal_end ();
+  return any;
+}
+
+/* Reclaim thread.  Frees removed inodes' sectors in the
+   background, a batch of inodes at a time. */
+static void
+reclaim_daemon (void *aux UNUSED)
+{
+  for (;;)
+    {
+      lock_acquire (&reclaim_lock);
+      while (list_empty (&reclaim_list))
+        cond_wait (&reclaim_cond, &reclaim_lock);
+      lock_release (&reclaim_lock);
+
+      inode_reclaim ();
+    }
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
@@ -343,18 +588,15 @@ inode_remove (struct inode *inode)
    OFFSETS and sets *OFFSET_CNT to the number of offsets. 
    offset_cnt can be 1 to 3 depending on whether sector_idx 
    points to sectors within DIRECT, INDIRECT, or DBL_INDIRECT ranges.
+   offset_cnt is 0 if sector_idx is out of range.
 */
 //Done
 static void
 calculate_indices (off_t sector_idx, size_t offsets[], size_t *offset_cnt)
 {
-
-  if(sector_idx < 0){
-    *offset_cnt = 0; // Indicate an error condition
-  }
-  if (sector_idx > INODE_SPAN){
-     // Sector index out of range
+  if (sector_idx < 0 || sector_idx >= INODE_SPAN / BLOCK_SECTOR_SIZE){
     *offset_cnt = 0; // Indicate an error condition
+    return;
   }
   
   if (sector_idx < DIRECT_CNT){
@@ -367,7 +609,6 @@ calculate_indices (off_t sector_idx, size_t offsets[], size_t *offset_cnt)
   sector_idx -= DIRECT_CNT; //123
 
   if (sector_idx < PTRS_PER_SECTOR){
-    //printf("inode.c,calculate_indices, indirect.\n");
     /* Handle indirect blocks. */
     // offset_cnt = 2, offsets[0] = DIRECT_CNT, offsets[1] ...
     *offset_cnt = 2;
@@ -377,300 +618,425 @@ calculate_indices (off_t sector_idx, size_t offsets[], size_t *offset_cnt)
   }
   sector_idx -= PTRS_PER_SECTOR;//128
   
-  if (sector_idx < (PTRS_PER_SECTOR*PTRS_PER_SECTOR)){
-    //printf("inode.c,calculate_indices, double indirect.\n");
-     /* Handle doubly indirect blocks. */
-    // offset_cnt = 3, offsets[0] = DIRECT_CNT + INDIRECT_CNT, offsets[1], offsets[2] ...
-    *offset_cnt = 3;
-    offsets[0] = DIRECT_CNT + 1; //Index of the doubly indrect block
-    offsets[1] = sector_idx / PTRS_PER_SECTOR; //Index of indirect block within doubly indirect block
-    offsets[2] = sector_idx; //Index within the indirect block
-    return;
+  /* Handle doubly indirect blocks. */
+  // offset_cnt = 3, offsets[0] = DIRECT_CNT + INDIRECT_CNT, offsets[1], offsets[2] ...
+  *offset_cnt = 3;
+  offsets[0] = DIRECT_CNT + 1; //Index of the doubly indrect block
+  offsets[1] = sector_idx / PTRS_PER_SECTOR; //Index of indirect block within doubly indirect block
+  offsets[2] = sector_idx % PTRS_PER_SECTOR; //Index within the indirect block
+}
+
+/* Allocates a sector for INODE, zeroes it and stores it into
+   *SECTORP.  The sector is the first free one after the last
+   sector allocated for INODE.
+   META is true if the sector will be an indirect block, whose
+   writes go through the journal.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_zeroed_sector (struct inode *inode, block_sector_t *sectorp, bool meta)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+
+  if (!free_map_allocate_near (inode->last_block + 1, sectorp))
+    return false;
+  inode->last_block = *sectorp;
+  if (meta)
+    cache_write_meta (*sectorp, zeros);
+  else
+    cache_write (*sectorp, zeros);
+  return true;
+}
+
+/* If INODE has a sector reserved for file sector SECTOR_IDX,
+   takes it out of the reservation, zeroes it and stores it into
+   *SECTORP.  Otherwise returns false.
+   INODE's disk_lock must be held. */
+static bool
+take_reserved_sector (struct inode *inode, size_t sector_idx,
+                      block_sector_t *sectorp)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+
+  if (sector_idx < inode->reserve_idx
+      || sector_idx - inode->reserve_idx >= inode->reserve_cnt)
+    return false;
+  *sectorp = inode->reserve_start + (sector_idx - inode->reserve_idx);
+  free_map_claim (*sectorp);
+  cache_write (*sectorp, zeros);
+  inode->last_block = *sectorp;
+  return true;
+}
+
+/* Gives back SECTOR, allocated for file sector SECTOR_IDX of
+   INODE but not mapped after all.  A sector taken from INODE's
+   reservation goes back into it, since the reservation still
+   covers SECTOR_IDX; any other sector is freed.
+   INODE's disk_lock must be held. */
+static void
+return_data_sector (struct inode *inode, size_t sector_idx,
+                    block_sector_t sector)
+{
+  if (sector_idx >= inode->reserve_idx
+      && sector_idx - inode->reserve_idx < inode->reserve_cnt
+      && sector == inode->reserve_start + (sector_idx - inode->reserve_idx))
+    free_map_unclaim (sector);
+  else
+    free_map_release (sector);
+}
+
+/* Allocates a zeroed data sector for file sector SECTOR_IDX of
+   INODE, from its reservation if there is one, and stores it
+   into *SECTORP.
+   Returns true if successful, false if the disk is full. */
+static bool
+allocate_data_sector (struct inode *inode, size_t sector_idx,
+                      block_sector_t *sectorp)
+{
+  return (take_reserved_sector (inode, sector_idx, sectorp)
+          || allocate_zeroed_sector (inode, sectorp, false));
+}
+
+static bool get_mapped_block (struct inode *, off_t, bool, block_sector_t *);
+
+/* Makes the next sector allocated for INODE follow the data
+   block of the sector before byte OFFSET, if it has one, so that
+   a file written in order is laid out in order however it was
+   opened.  INODE's disk_lock must be held. */
+static void
+follow_previous_block (struct inode *inode, off_t offset)
+{
+  block_sector_t prev;
+
+  if (offset >= BLOCK_SECTOR_SIZE
+      && get_mapped_block (inode, offset - BLOCK_SECTOR_SIZE, false, &prev)
+      && prev != 0){
+    inode->last_block = prev;
   }
 }
 
-/* Retrieves the data block for the given byte OFFSET in INODE,
-   setting *DATA_BLOCK to the block and data_sector to the sector to write 
-   (for inode_write_at method).
+/* Retrieves the data sector for the given byte OFFSET in INODE,
+   storing it into *DATA_SECTOR.
 
    Returns true if successful, false on failure.
 
    If ALLOCATE is false (usually for inode read), 
-   then missing blocks will be successful with *DATA_BLOCK set to a null pointer.
+   then missing blocks will be successful with *DATA_SECTOR set to 0.
 
-   If ALLOCATE is true (for inode write), then missing blocks will be allocated. 
-   This method may be called in parallel */
+   If ALLOCATE is true (for inode write), then missing blocks
+   (including any indirect blocks on the way) will be allocated.
 
-static bool handle_direct_block(struct inode* inode, size_t block_index, bool allocate, void** data_block, block_sector_t* data_sector){
-  // Allocate space for disk_inode
+   Walks the resident sector map in INODE->data and then reads
+   one pointer per indirection level out of the buffer cache.
+   INODE's disk_lock must be held. */
+static bool
+get_mapped_block (struct inode *inode, off_t offset, bool allocate,
+                  block_sector_t *data_sector)
+{
+  size_t offsets[3];
+  size_t offset_cnt;
+  block_sector_t sector;
+  bool placed = false;
   
-  struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
-  if(disk_inode == NULL){return false;}
-  // Read the inode_disk data from the inode
-  block_read(fs_device, inode->sector, disk_inode);
-
-  // Retrieve sector
-  block_sector_t sector = disk_inode->sectors[block_index];
-  if(sector == 0 && allocate){//check if needed to allocate
-    if(!free_map_allocate(&sector)){
-      free(disk_inode);
-      return false;
-    }
-    disk_inode->sectors[block_index] = sector; //Update since allocated
-    
-    void* new_block_data = calloc(1, BLOCK_SECTOR_SIZE);
-    if(new_block_data == NULL){
-      free(disk_inode);
-      free_map_release(sector); 
-      return false;
-    } //Memory allocation failed
-    block_write(fs_device, sector, new_block_data);
-    free(new_block_data);
-    block_write(fs_device, inode->sector, disk_inode);
+  ASSERT(inode != NULL);
+  ASSERT(offset >= 0);
+  ASSERT(lock_held_by_current_thread(&inode->disk_lock));
 
+  calculate_indices(offset / BLOCK_SECTOR_SIZE, offsets, &offset_cnt);
+  if (offset_cnt == 0){
+    return false; //Block index out of range
   }
 
-  *data_sector = sector; //Update the sector number for the caller
-  //If sector is not zero, read data from the block
-  if(sector != 0){
-    *data_block = malloc(BLOCK_SECTOR_SIZE);
-    if(*data_block == NULL){
-      free(disk_inode);
+  //***First Level: the pointer lives in the resident inode
+  sector = inode->data.sectors[offsets[0]];
+  if (sector == 0){
+    if (!allocate){
+      *data_sector = 0;
+      return true;
+    }
+    follow_previous_block(inode, offset);
+    placed = true;
+    if (offset_cnt > 1 ? !allocate_zeroed_sector(inode, &sector, true)
+                       : !allocate_data_sector(inode, offset / BLOCK_SECTOR_SIZE, &sector)){
       return false;
     }
-    block_read(fs_device, sector, *data_block);
-  }else{
-    //return NULL in *data_block if not allocating
-    *data_block = NULL;
+    inode->data.sectors[offsets[0]] = sector;
+    inode->dirty = true;
+  }
+    
+  //***Remaining Levels: the pointer lives in an indirect block
+  for (size_t level = 1; level < offset_cnt; level++){
+    block_sector_t next;
+    off_t ptr_ofs = offsets[level] * sizeof next;
+
+    cache_read_at(sector, &next, ptr_ofs, sizeof next);
+    if (next == 0){
+      if (!allocate){
+        *data_sector = 0;
+        return true;
+      }
+      if (!placed){
+        follow_previous_block(inode, offset);
+        placed = true;
+      }
+      if (level + 1 < offset_cnt ? !allocate_zeroed_sector(inode, &next, true)
+                                 : !allocate_data_sector(inode, offset / BLOCK_SECTOR_SIZE, &next)){
+        return false;
+      }
+      cache_write_meta_at(sector, &next, ptr_ofs, sizeof next);
+    }
+    sector = next;
   }
 
-  free(disk_inode);
+  *data_sector = sector; //Update the sector number for the caller
   return true;
 }
 
-static bool handle_indirect_block(struct inode* inode, size_t block_index, bool allocate, void** data_block, block_sector_t* data_sector){
-  //printf("inode.c,handle_indirect_block.\n");
-  size_t offsets[3];
-  size_t offset_cnt;
-  calculate_indices(block_index, offsets, &offset_cnt);
-  size_t indirect_block_index = offsets[0];
-  size_t direct_block_offset = offsets[1];
-
-  //***First Level: Get indirect block index to retrieve indirect_block
-  // Allocate space for disk_inode
-  struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
-  if(disk_inode == NULL) {return false;}
-  // Read the inode_disk data from the inode
-  block_read(fs_device, inode->sector, disk_inode);
-  // Retrieve indirect sector
-  block_sector_t indirect_sector = disk_inode->sectors[indirect_block_index];
-  if(indirect_sector == 0 && allocate){ //allocate if needed
-    if(!free_map_allocate(&indirect_sector)){
-      free(disk_inode);
-      return false;
-    }
-    disk_inode->sectors[indirect_block_index] = indirect_sector; //Update indirect sector info
-    void* new_block_data = calloc(1, BLOCK_SECTOR_SIZE);
-    if(new_block_data == NULL){
-      free(disk_inode);
-      free_map_release(indirect_sector); 
-      return false;
-    } //Memory allocation failed
-    block_write(fs_device, indirect_sector, new_block_data);
-    free(new_block_data);
-    block_write(fs_device, inode->sector, disk_inode);
-  }
-  free(disk_inode);
+/* Zeroes the CNT sectors starting at SECTOR. */
+static void
+zero_sectors (block_sector_t sector, size_t cnt)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+
+  for (; cnt > 0; cnt--)
+    cache_write (sector++, zeros);
+}
+
+/* Free sectors wanted after a new extent, so that it can grow as
+   the file is written sector by sector. */
+#define EXTENT_SLACK 64
 
-  //***Second Level: Retrieve indirect_block, and get direct block data
-  //BELOW is similar logic in handle_direct_block, can consider replace
-  struct inode_disk *disk_inode2 = malloc(sizeof(struct inode_disk));
-  if(disk_inode2 == NULL){return false;}
-  uint32_t *indirect_block = malloc(BLOCK_SECTOR_SIZE);
-  if(indirect_block == NULL){
-    free(disk_inode2);
+/* Makes room for CNT extents at index I of EXTENTS, which has
+   USED extents in use, by moving the later ones up.
+   Returns false if there are not enough extents left. */
+static bool
+insert_extents (struct extent *extents, size_t used, size_t i, size_t cnt)
+{
+  if (used + cnt > EXTENT_CNT){
     return false;
   }
-  if(indirect_sector != 0){block_read(fs_device, indirect_sector, disk_inode2);}
-  else{memset(indirect_block, 0, BLOCK_SECTOR_SIZE);}
- 
-  block_sector_t sector = disk_inode2->sectors[direct_block_offset];
-  if(sector == 0 && allocate){ //allocate if needed
-    if(!free_map_allocate(&sector)){
-      free(disk_inode2);
-      free(indirect_block);
-      return false;
+  memmove (&extents[i + cnt], &extents[i], (used - i) * sizeof *extents);
+  return true;
+}
+
+/* Allocates one zeroed data sector for INODE's file sector
+   SECTOR_IDX, which follows extent PREV, or is the first file
+   sector if PREV is null.
+   The sector goes at the end of PREV when that sector is free,
+   growing PREV, in which case true is stored in *GREW.
+   Otherwise it starts a new extent after the last sector
+   allocated for INODE.  A sector reserved for SECTOR_IDX is
+   used in either case.
+   Returns the sector, or 0 if the disk is full. */
+static block_sector_t
+allocate_extent_sector (struct inode *inode, size_t sector_idx,
+                        struct extent *prev, bool *grew)
+{
+  block_sector_t sector;
+
+  *grew = false;
+  if (take_reserved_sector (inode, sector_idx, &sector)){
+    if (prev != NULL && !is_hole (prev) && prev->start + prev->length == sector){
+      prev->length++;
+      *grew = true;
     }
-    disk_inode2->sectors[direct_block_offset] = sector; //Update direct sector info 
-    void* new_block_data2 = calloc(1, BLOCK_SECTOR_SIZE);
-    if(new_block_data2 == NULL){
-      free(disk_inode2);
-      free_map_release(sector); 
-      return false;
-    } //Memory allocation failed
-    block_write(fs_device, sector, new_block_data2);
-    free(new_block_data2);
-    block_write(fs_device, indirect_sector, disk_inode2);
+    return sector;
   }
-
-  *data_sector = sector; //Update the sector number for the caller
-  if(sector != 0){
-    *data_block = malloc(BLOCK_SECTOR_SIZE);
-    if(*data_block == NULL){
-      free(disk_inode2);
-      free(indirect_block);
-      return false;
+  if (prev != NULL && !is_hole (prev)){
+    sector = prev->start + prev->length;
+    if (free_map_allocate_at (sector, 1) == 1){
+      prev->length++;
+      *grew = true;
+      zero_sectors (sector, 1);
+      inode->last_block = sector;
+      return sector;
     }
-    block_read(fs_device, sector, *data_block);
-  }else{
-    *data_block = NULL;
   }
-
-  free(disk_inode2);
-  free(indirect_block);
-  return true;
+  if (free_map_allocate_run (1, EXTENT_SLACK, inode->last_block + 1, &sector) == 0){
+    return 0;
+  }
+  zero_sectors (sector, 1);
+  inode->last_block = sector;
+  return sector;
 }
 
-static bool handle_doubly_indirect_block(struct inode* inode, size_t block_index,
- bool allocate, void** data_block, block_sector_t* data_sector){
-  //printf("inode.c,handle_doubly_indirect_block.\n");
-  size_t offsets[3];
-  size_t offset_cnt;
-  calculate_indices(block_index, offsets, &offset_cnt);
-  size_t dbl_indirect_block_index = offsets[0];
-  size_t indirect_block_index = offsets[1];
-  size_t direct_block_offset = offsets[2];
-
-  //***First Level: Get dbl indirect block index to retrieve dbl indirect_block
-  // Allocate space for disk_inode
-  struct inode_disk *disk_inode = malloc(sizeof(struct inode_disk));
-  if(disk_inode == NULL){return false;}
-  // Read the inode_disk data from the inode
-  block_read(fs_device, inode->sector, disk_inode);
-  // Retrieve dbl indirect sector
-  block_sector_t dbl_indirect_sector = disk_inode->sectors[dbl_indirect_block_index];
-  if(dbl_indirect_sector == 0 && allocate){ //allocate if needed
-    if(!free_map_allocate(&dbl_indirect_sector)){
-      free(disk_inode);
-      return false;
+/* Same as get_mapped_block(), for an inode that maps its data
+   with extents.  The extents cover the file's sectors in order.
+   Sectors that have never been written are covered by holes,
+   extents that start at sector 0, so a write far past the end
+   of the file allocates only the sector written.  New sectors go
+   at the end of the extent before them when the sectors after it
+   are free, so that files stay contiguous.
+   Fails if the inode runs out of extents.
+   INODE's disk_lock must be held. */
+static bool
+get_extent_block (struct inode *inode, off_t offset, bool allocate,
+                  block_sector_t *data_sector)
+{
+  struct extent *extents = inode->data.extents;
+  size_t sector_idx = offset / BLOCK_SECTOR_SIZE;
+  size_t base = 0;
+  size_t used;
+  size_t i;
+  block_sector_t sector;
+  bool grew;
+
+  ASSERT(lock_held_by_current_thread(&inode->disk_lock));
+
+  for (i = 0; i < EXTENT_CNT && extents[i].length > 0; i++){
+    if (sector_idx < base + extents[i].length){
+      break;
     }
-    disk_inode->sectors[dbl_indirect_block_index] = dbl_indirect_sector; //Update indirect sector info
-    void* new_block_data = calloc(1, BLOCK_SECTOR_SIZE);
-    if(new_block_data == NULL){
-      free(disk_inode);
-      free_map_release(dbl_indirect_sector); 
-      return false;
-    } //Memory allocation failed
-    block_write(fs_device, dbl_indirect_sector, new_block_data);
-    free(new_block_data);
-    block_write(fs_device, inode->sector, disk_inode);
+    base += extents[i].length;
+  }
+  used = i;
+  while (used < EXTENT_CNT && extents[used].length > 0){
+    used++;
+  }
+
+  if (i < used && !is_hole (&extents[i])){
+    *data_sector = extents[i].start + (sector_idx - base);
+    return true;
+  }
+  if (!allocate){
+    *data_sector = 0;
+    return true;
   }
-  free(disk_inode);
 
-  //BELOW is similar logic in handle_indirect_block, can consider replace by calling that function
-  //***Second Level: Get indirect block index to retrieve indirect_block
-  // Allocate space for disk_inode
-  struct inode_disk *disk_inode2 = malloc(sizeof(struct inode_disk));
-  if(disk_inode2 == NULL){return false;}
-  uint32_t *indirect_block = malloc(BLOCK_SECTOR_SIZE);
-  if(indirect_block == NULL){return false;}
-  if(dbl_indirect_sector != 0){block_read(fs_device, dbl_indirect_sector, disk_inode2);}
-  else{memset(indirect_block, 0, BLOCK_SECTOR_SIZE);}
-
-  // Retrieve dbl indirect sector
-  block_sector_t indirect_sector = disk_inode2->sectors[indirect_block_index];
-  if(indirect_sector == 0 && allocate){
-    if(!free_map_allocate(&indirect_sector)){
-      free(disk_inode2);
-      free(indirect_block);
+  if (i < used){
+    // Fill one sector of hole I, which starts at file sector BASE.
+    size_t before = sector_idx - base;
+    size_t after = extents[i].length - before - 1;
+    size_t extra = (before > 0) + (after > 0);
+
+    sector = allocate_extent_sector (inode, sector_idx, before == 0 && i > 0 ? &extents[i - 1] : NULL, &grew);
+    if (sector == 0){
       return false;
     }
-    disk_inode2->sectors[indirect_block_index] = indirect_sector; //Update indirect sector info
-    void* new_block_data2 = calloc(1, BLOCK_SECTOR_SIZE);
-    if(new_block_data2 == NULL){
-      free(disk_inode2);
-      free_map_release(indirect_sector); 
+    inode->dirty = true;
+    *data_sector = sector;
+    if (grew){
+      // The extent in front of the hole took the sector.
+      if (--extents[i].length == 0){
+        memmove (&extents[i], &extents[i + 1], (used - i - 1) * sizeof *extents);
+        extents[used - 1].length = 0;
+      }
+      return true;
+    }
+
+    // Split the hole around a new one-sector extent.
+    if (!insert_extents (extents, used, i, extra)){
+      return_data_sector (inode, sector_idx, sector);
       return false;
-    } //Memory allocation failed
-    block_write(fs_device, indirect_sector, new_block_data2);
-    free(new_block_data2);
-    block_write(fs_device, dbl_indirect_sector, disk_inode2);
-  }
-  free(disk_inode2);
-
-  //***Third Level: Get direct block index to retrieve direct_block
-  struct inode_disk *disk_inode3 = malloc(sizeof(struct inode_disk));
-  uint32_t *direct_block = malloc(BLOCK_SECTOR_SIZE);
-  if(direct_block == NULL){return false;}
-  if(dbl_indirect_sector != 0 && indirect_sector != 0){
-    block_read(fs_device, indirect_sector, disk_inode3);
-  }else{
-    memset(direct_block, 0, BLOCK_SECTOR_SIZE); //if direct_block has previously not been allocated
+    }
+    if (before > 0){
+      extents[i].start = 0;
+      extents[i++].length = before;
+    }
+    extents[i].start = sector;
+    extents[i].length = 1;
+    if (after > 0){
+      extents[i + 1].start = 0;
+      extents[i + 1].length = after;
+    }
+    return true;
   }
 
-  block_sector_t sector = disk_inode3->sectors[direct_block_offset];
-  if(sector == 0 && allocate){ //allocate if needed
-    if(!free_map_allocate(&sector)){
-      free(disk_inode3);
-      free(direct_block);
+  // Past the end: cover any gap with a hole, then add the sector.
+  if (sector_idx > base){
+    if (i > 0 && is_hole (&extents[i - 1])){
+      extents[i - 1].length += sector_idx - base;
+    }else if (i < EXTENT_CNT){
+      extents[i].start = 0;
+      extents[i++].length = sector_idx - base;
+    }else{
       return false;
     }
-    disk_inode3->sectors[direct_block_offset] = sector; //Update direct sector info 
-    void* new_block_data3 = calloc(1, BLOCK_SECTOR_SIZE);
-    if(new_block_data3 == NULL){
-      free(disk_inode3);
-      free_map_release(sector); 
-      return false;
-    } //Memory allocation failed
-    block_write(fs_device, sector, new_block_data3);
-    free(new_block_data3);
-    block_write(fs_device, indirect_sector, disk_inode3);
+    inode->dirty = true;
   }
-
-  *data_sector = sector; //Update the sector number for the caller
-  if(sector != 0){
-    *data_block = malloc(BLOCK_SECTOR_SIZE);
-    if(*data_block == NULL){
-      free(disk_inode3);
-      free(direct_block);
+  sector = allocate_extent_sector (inode, sector_idx, i > 0 ? &extents[i - 1] : NULL, &grew);
+  if (sector == 0){
+    return false;
+  }
+  if (!grew){
+    if (i >= EXTENT_CNT){
+      return_data_sector (inode, sector_idx, sector);
       return false;
     }
-    block_read(fs_device, sector, *data_block);
-  }else{
-    *data_block = NULL;
+    extents[i].start = sector;
+    extents[i].length = 1;
   }
-
-  free(disk_inode3);
-  free(direct_block);
+  inode->dirty = true;
+  *data_sector = sector;
   return true;
 }
+
+/* Returns true if INODE's contents are file system metadata,
+   whose writes go through the journal: directories and the free
+   map. */
 static bool
-get_data_block (struct inode *inode, off_t offset, bool allocate,
-                void **data_block, block_sector_t *data_sector)
+holds_metadata (const struct inode *inode)
 {
-  ASSERT(inode != NULL);
-  ASSERT(offset >= 0);
+  return inode->data.type == DIR_INODE || inode->key.sector == FREE_MAP_SECTOR;
+}
 
-  size_t block_index = offset/BLOCK_SECTOR_SIZE;
-  size_t direct_block_limit = DIRECT_CNT;
-  size_t indirect_block_limit = DIRECT_CNT + PTRS_PER_SECTOR * INDIRECT_CNT;
-  size_t doubly_indirect_block_limit = indirect_block_limit + PTRS_PER_SECTOR * PTRS_PER_SECTOR * INDIRECT_CNT;
+static bool get_data_block (struct inode *, off_t, bool, block_sector_t *);
 
-  if(block_index < direct_block_limit){
-    return handle_direct_block(inode, block_index, allocate, data_block, data_sector);
-  }
-  
-  else if(block_index < indirect_block_limit){
-    return handle_indirect_block(inode, block_index, allocate, data_block, data_sector);
-  }
-  
-  else if(block_index < doubly_indirect_block_limit){
-      return handle_doubly_indirect_block(inode, block_index, allocate,data_block,data_sector);
+/* Switches INODE from keeping its data inline to the file
+   system's layout, moving the data to a newly allocated first
+   data sector.  Returns false, leaving INODE inline, if the disk
+   is full.  INODE's disk_lock must be held. */
+static bool
+move_inline_data (struct inode *inode)
+{
+  uint8_t data[INLINE_MAX];
+  block_sector_t sector;
+
+  ASSERT(lock_held_by_current_thread(&inode->disk_lock));
+
+  memcpy (data, inode->data.inline_data, INLINE_MAX);
+  memset (inode->data.inline_data, 0, INLINE_MAX);
+  inode->data.magic = layout_magic ();
+  inode->dirty = true;
+  if (inode->data.length == 0){
+    return true;
   }
-  
-  else{
-    return false; //Block index out oof range
+
+  if (!get_data_block (inode, 0, true, &sector)){
+    memcpy (inode->data.inline_data, data, INLINE_MAX);
+    inode->data.magic = INLINE_MAGIC;
+    return false;
   }
+  // bytes past the end are always zero, so the whole area can go
+  if (holds_metadata (inode))
+    cache_write_meta_at (sector, data, 0, INLINE_MAX);
+  else
+    cache_write_at (sector, data, 0, INLINE_MAX);
+  return true;
+}
+
+/* Retrieves the data sector for the given byte OFFSET in INODE,
+   using whichever layout INODE was created with.
+   See get_mapped_block() for the meaning of the arguments.
+   An inline inode has no data sectors, so allocating one moves
+   its data out of the inode first.
+   INODE's disk_lock must be held. */
+static bool
+get_data_block (struct inode *inode, off_t offset, bool allocate,
+                block_sector_t *data_sector)
+{
+  if (inode->data.magic == INLINE_MAGIC)
+    {
+      if (!allocate)
+        {
+          *data_sector = 0;
+          return true;
+        }
+      if (!move_inline_data (inode))
+        return false;
+    }
+  if (inode->data.magic == EXTENT_MAGIC)
+    return get_extent_block (inode, offset, allocate, data_sector);
+  return get_mapped_block (inode, offset, allocate, data_sector);
 }
 
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
@@ -683,14 +1049,29 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
    uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  block_sector_t target_sector = 0; // not really useful for inode_read
+
+  rwlock_acquire_read (&inode->rw_lock);
+
+  // inline data is already in memory, in the resident inode
+  lock_acquire (&inode->disk_lock);
+  if (inode->data.magic == INLINE_MAGIC)
+    {
+      if (offset < inode->data.length)
+        {
+          bytes_read = inode->data.length - offset;
+          if (size < bytes_read)
+            bytes_read = size;
+          memcpy (buffer, inode->data.inline_data + offset, bytes_read);
+        }
+      size = 0;
+    }
+  lock_release (&inode->disk_lock);
 
   while (size > 0)
     {
-      /* Sector to read, starting byte offset within sector, sector data. */
+      /* Sector to read, starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-      void *block; // may need to be allocated in get_data_block method,
-                   // and don't forget to free it in the end
+      block_sector_t sector;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
@@ -699,99 +1080,212 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 
       /* Number of bytes to actually copy out of this sector. */
       int chunk_size = size < min_left ? size : min_left;
-      if (chunk_size <= 0 || !get_data_block (inode, offset, false, &block, &target_sector))
+      if (chunk_size <= 0)
+        break;
+
+      lock_acquire (&inode->disk_lock);
+      bool ok = get_data_block (inode, offset, false, &sector);
+      lock_release (&inode->disk_lock);
+      if (!ok)
         break;
 
-      if (block == NULL)
+      if (sector == 0)
         memset (buffer + bytes_read, 0, chunk_size);
       else
-        {
-          memcpy (buffer + bytes_read, block + sector_ofs, chunk_size);
-        }
+        cache_read_at (sector, buffer + bytes_read, sector_ofs, chunk_size);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
-
-      free(block);
     }
 
+  rwlock_release_read (&inode->rw_lock);
   return bytes_read;
 }
 
-/* Extends INODE to be at least LENGTH bytes long. */
-//Done
-static void update_inode_length(struct inode *inode, off_t new_length);
-static void extend_file(struct inode *inode, off_t length) {
-  // Check if the inode length is already sufficient
-  if (inode_length(inode) >= length) {
-    return; // No extension needed
+/* Starts loading the sectors that hold SIZE bytes of INODE at
+   OFFSET into the buffer cache in the background, without
+   waiting for them.  Holes and bytes past end of file are
+   skipped. */
+void
+inode_readahead (struct inode *inode, off_t size, off_t offset)
+{
+  off_t end;
+
+  lock_acquire (&inode->disk_lock);
+  end = offset + size < inode->data.length ? offset + size : inode->data.length;
+  offset = ROUND_DOWN (offset, BLOCK_SECTOR_SIZE);
+  for (; offset < end; offset += BLOCK_SECTOR_SIZE)
+    {
+      block_sector_t sector;
+      if (!get_data_block (inode, offset, false, &sector))
+        break;
+      if (sector != 0)
+        cache_readahead (sector);
+    }
+  lock_release (&inode->disk_lock);
+}
+
+/* Extends INODE to be at least NEW_LENGTH bytes long.
+   Nothing is allocated: sectors past the old end that are not
+   written read as zeros.
+   INODE's disk_lock must be held. */
+static void update_inode_length(struct inode *inode, off_t new_length) {
+  if (new_length > inode->data.length) {
+    inode->data.length = new_length;
+    inode->dirty = true;
   }
+}
 
-  off_t current_length = inode_length(inode);
-  while (current_length < length) {
-    // Calculate the sector index for the next block to allocate
-    off_t sector_idx = bytes_to_sectors(current_length);
+static bool extend_locked (struct inode *, off_t length);
 
-    // Allocate the next block if necessary
-    block_sector_t sector;
-    void *dummy_block; // Placeholder for get_data_block
+/* Extends INODE to be at least LENGTH bytes long.  The new bytes
+   read as zeros and take no space on disk until they are
+   written.  Returns false if LENGTH is larger than the largest
+   possible file. */
+bool
+inode_extend (struct inode *inode, off_t length)
+{
+  bool ok;
+
+  lock_acquire (&inode->extend_lock);
+  ok = extend_locked (inode, length);
+  lock_release (&inode->extend_lock);
+  return ok;
+}
 
-    if (!get_data_block(inode, sector_idx * BLOCK_SECTOR_SIZE, true, &dummy_block, &sector)) {
-      break; // Break on allocation failure
+/* Does the work of inode_extend(), with INODE's extend_lock
+   held. */
+static bool
+extend_locked (struct inode *inode, off_t length)
+{
+  if (length > INODE_SPAN)
+    return false;
+
+  journal_begin ();
+  lock_acquire (&inode->disk_lock);
+  if (inode->data.magic == INLINE_MAGIC && length > INLINE_MAX
+      && !move_inline_data (inode))
+    {
+      lock_release (&inode->disk_lock);
+      journal_end ();
+      return false;
     }
+  update_inode_length (inode, length);
+  inode_writeback (inode);
+  lock_release (&inode->disk_lock);
+  journal_end ();
+  return true;
+}
 
-    // Free the dummy block allocated by get_data_block
-    free(dummy_block); // Safe to call free on NULL
 
-    // Advance the length to the end of the newly allocated block
-    current_length = ((sector_idx + 1) * BLOCK_SECTOR_SIZE > length) ? length : (sector_idx + 1) * BLOCK_SECTOR_SIZE;
-  }
+/* Reserves space for the LENGTH bytes of INODE starting at
+   OFFSET, extending INODE to cover them if needed.  The sectors
+   in that range that are not allocated yet (after any that are)
+   are reserved as one contiguous run, following the file's
+   previous block, with a single free map operation.  They are
+   not zeroed or marked in use on disk; writes to the range take
+   them in order instead of allocating.  If there is no free run
+   that long, a shorter one covers the start of the range.
+   Whatever is not written is freed when INODE is last closed or
+   reserves space again.  Returns false if writes to INODE are
+   denied or the range is past the largest possible file. */
+bool
+inode_reserve (struct inode *inode, off_t offset, off_t length)
+{
+  size_t first, cnt;
+  block_sector_t sector;
+  bool denied;
 
-  // Update the inode length if it has been extended
-  update_inode_length(inode, current_length);
-}
+  if (offset < 0 || length < 0 || length > INODE_SPAN - offset)
+    return false;
+  lock_acquire (&inode->deny_write_lock);
+  denied = inode->deny_write_cnt > 0;
+  lock_release (&inode->deny_write_lock);
+  lock_acquire (&inode->extend_lock);
+  if (denied || !extend_locked (inode, offset + length))
+    {
+      lock_release (&inode->extend_lock);
+      return false;
+    }
 
-static void update_inode_length(struct inode *inode, off_t new_length) {
-  if (new_length > inode_length(inode)) {
-    struct inode_disk disk_inode;
-    block_read(fs_device, inode->sector, &disk_inode);
-    disk_inode.length = new_length;
-    block_write(fs_device, inode->sector, &disk_inode);
-  }
-}
+  first = offset / BLOCK_SECTOR_SIZE;
+  cnt = DIV_ROUND_UP (offset + length, BLOCK_SECTOR_SIZE) - first;
 
+  lock_acquire (&inode->disk_lock);
+  release_reservation (inode);
+  if (inode->data.magic != INLINE_MAGIC)
+    {
+      while (cnt > 0
+             && get_data_block (inode, first * BLOCK_SECTOR_SIZE, false, &sector)
+             && sector != 0)
+        {
+          first++;
+          cnt--;
+        }
+      if (first > 0
+          && get_data_block (inode, (first - 1) * BLOCK_SECTOR_SIZE, false, &sector)
+          && sector != 0)
+        inode->last_block = sector;
+      if (cnt > 0)
+        {
+          inode->reserve_idx = first;
+          inode->reserve_cnt = free_map_reserve (cnt, inode->last_block + 1,
+                                                 &inode->reserve_start);
+        }
+    }
+  lock_release (&inode->disk_lock);
+  lock_release (&inode->extend_lock);
+  return true;
+}
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if an error occurs. 
-   Some modifications might be needed for this function template.*/
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset)
+/* Writes SIZE bytes from BUFFER into INODE's inline data at
+   OFFSET, along with the new length, and returns true, if INODE
+   keeps its data inline and they fit.  Otherwise does nothing
+   and returns false; the first sector allocated for the write
+   then moves the inline data out. */
+static bool
+write_inline (struct inode *inode, const uint8_t *buffer, off_t size,
+              off_t offset)
 {
+  bool done = false;
 
-  const uint8_t *buffer = buffer_;
-  off_t bytes_written = 0;
-  block_sector_t target_sector = 0;
+  // an inode never goes back to inline, so a stale look is safe
+  if (inode->data.magic != INLINE_MAGIC || offset + size > INLINE_MAX)
+    return false;
 
-  /* Don't write if writes are denied. */
-  lock_acquire (&inode->deny_write_lock);
-  if (inode->deny_write_cnt)
+  journal_begin ();
+  lock_acquire (&inode->disk_lock);
+  if (inode->data.magic == INLINE_MAGIC)
     {
-      lock_release (&inode->deny_write_lock);
-      return 0;
+      memcpy (inode->data.inline_data + offset, buffer, size);
+      inode->dirty = true;
+      update_inode_length (inode, offset + size);
+      inode_writeback (inode);
+      done = true;
     }
-  inode->writer_cnt++;
-  lock_release (&inode->deny_write_lock);
+  lock_release (&inode->disk_lock);
+  journal_end ();
+  return done;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE's sectors, starting
+   at OFFSET, allocating sectors as needed.  Does not update the
+   length.  Returns the number of bytes actually written, which
+   may be less than SIZE if the disk is full. */
+static off_t
+write_sectors (struct inode *inode, const uint8_t *buffer, off_t size,
+               off_t offset)
+{
+  off_t bytes_written = 0;
+  bool retried = false;
 
   while (size > 0)
     {
-      /* Sector to write, starting byte offset within sector, sector data. */
+      /* Sector to write, starting byte offset within sector. */
       int sector_ofs = offset % BLOCK_SECTOR_SIZE;
-      void *block; // may need to be allocated in get_data_block method,
-                   // and don't forget to free it in the end
+      block_sector_t sector;
 
       /* Bytes to max inode size, bytes left in sector, lesser of the two. */
       off_t inode_left = INODE_SPAN - offset;
@@ -800,22 +1294,104 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 
       /* Number of bytes to actually write into this sector. */
       int chunk_size = size < min_left ? size : min_left;
- 
-      if (chunk_size <= 0 || !get_data_block (inode, offset, true, &block, &target_sector)){
+      if (chunk_size <= 0)
         break;
-      }
+ 
+      // Each sector is its own transaction, so large writes do not
+      // overflow the journal. Blocks allocated here are linked into
+      // the inode within it; only the length waits for the end.
+      journal_begin ();
+      lock_acquire (&inode->disk_lock);
+      bool ok = get_data_block (inode, offset, true, &sector);
+      inode_writeback (inode);
+      lock_release (&inode->disk_lock);
+      if (!ok)
+        {
+          // The disk may only be full of removed files waiting to
+          // be freed; free them now and try once more.
+          journal_end ();
+          if (!retried && inode_reclaim ())
+            {
+              retried = true;
+              continue;
+            }
+          break;
+        }
 
-      memcpy (block + sector_ofs, buffer + bytes_written, chunk_size);
-      block_write(fs_device, target_sector, block);
+      if (holds_metadata (inode))
+        cache_write_meta_at (sector, buffer + bytes_written, sector_ofs, chunk_size);
+      else
+        cache_write_at (sector, buffer + bytes_written, sector_ofs, chunk_size);
+      journal_end ();
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
-      free(block);
     }
 
-  extend_file (inode, offset);
+  return bytes_written;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if an error occurs. 
+   Bytes before the end of file are written holding the
+   reader/writer lock for writing.  A write that grows the file
+   holds the extend lock instead for the bytes past the end, and
+   the new length is set once they are written. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset)
+{
+
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  /* Don't write if writes are denied. */
+  lock_acquire (&inode->deny_write_lock);
+  if (inode->deny_write_cnt)
+    {
+      lock_release (&inode->deny_write_lock);
+      return 0;
+    }
+  inode->writer_cnt++;
+  lock_release (&inode->deny_write_lock);
+
+  // The length only grows, and only under the extend lock, so once
+  // it is held (or not needed) EOF cannot move past END.
+  off_t end = offset + size;
+  bool extending = end > inode_length (inode);
+  if (extending)
+    lock_acquire (&inode->extend_lock);
+  off_t eof = inode_length (inode);
+  off_t mid = eof < offset ? offset : eof < end ? eof : end;
+
+  if (write_inline (inode, buffer, size, offset))
+    bytes_written = size;
+  else
+    {
+      if (mid > offset)
+        {
+          rwlock_acquire_write (&inode->rw_lock);
+          bytes_written = write_sectors (inode, buffer, mid - offset, offset);
+          rwlock_release_write (&inode->rw_lock);
+        }
+      if (bytes_written == mid - offset && end > mid)
+        bytes_written += write_sectors (inode, buffer + bytes_written,
+                                        end - mid, mid);
+    }
+
+  if (extending)
+    {
+      journal_begin ();
+      lock_acquire (&inode->disk_lock);
+      update_inode_length (inode, offset + bytes_written);
+      inode_writeback (inode);
+      lock_release (&inode->disk_lock);
+      journal_end ();
+      lock_release (&inode->extend_lock);
+    }
 
   lock_acquire (&inode->deny_write_lock);
   if (--inode->writer_cnt == 0)
@@ -831,7 +1407,12 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
 void
 inode_deny_write (struct inode *inode) 
 { 
+  // writes already under way finish first
+  lock_acquire (&inode->deny_write_lock);
+  while (inode->writer_cnt > 0)
+    cond_wait (&inode->no_writers_cond, &inode->deny_write_lock);
   inode->deny_write_cnt++;
+  lock_release (&inode->deny_write_lock);
 }
 
 /* Re-enables writes to INODE.
@@ -841,7 +1422,9 @@ inode_deny_write (struct inode *inode)
 void
 inode_allow_write (struct inode *inode) 
 { 
+  lock_acquire (&inode->deny_write_lock);
   inode->deny_write_cnt--;
+  lock_release (&inode->deny_write_lock);
 }
 
 /* Returns the length, in bytes, of INODE's data. */
@@ -849,12 +1432,17 @@ inode_allow_write (struct inode *inode)
 off_t
 inode_length (const struct inode *inode)
 {
-  struct inode_disk *buffer = calloc(1, sizeof *buffer);
-  block_read (fs_device, inode->sector, buffer);
-  int length = buffer->length;
+  // a single aligned word, only ever grown under disk_lock
+  return inode->data.length;
+}
 
-  free (buffer);
-  return length;
+/* Returns true if INODE has been removed.  inode_remove() takes
+   INODE's lock, so the answer holds for as long as the caller
+   keeps inode_lock() on INODE. */
+bool
+inode_is_removed (const struct inode *inode)
+{
+  return inode->removed;
 }
 
 /* Returns the number of openers. */
@@ -885,4 +1473,4 @@ void
 inode_unlock (struct inode *inode)
 {
   lock_release (&inode->lock);
-}
\ No newline at end of file
+}
@@ -6,6 +6,7 @@
 #include "devices/block.h"
 
 struct bitmap;
+struct inode;
 
 /* TA note: Most of the modifications for large files 
    will be around inode.h and inode.c */
@@ -17,7 +18,16 @@ enum inode_type
     DIR_INODE           /* Directory. */
   };
 
+/* On-disk layout used to map an inode's data sectors. */
+enum inode_layout
+  {
+    LAYOUT_BLOCK_MAP,   /* Direct, indirect, doubly indirect sectors. */
+    LAYOUT_EXTENTS      /* Runs of consecutive sectors. */
+  };
+
 void inode_init (void);
+void inode_set_layout (enum inode_layout);
+enum inode_layout inode_get_layout (const struct inode *);
 struct inode *inode_create (block_sector_t, enum inode_type);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -25,12 +35,17 @@ enum inode_type inode_get_type (const struct inode *);
 block_sector_t inode_get_inumber (const struct inode *);
 void inode_close (struct inode *);
 void inode_remove (struct inode *);
+bool inode_reclaim (void);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_extend (struct inode *, off_t length);
+bool inode_reserve (struct inode *, off_t offset, off_t length);
+void inode_readahead (struct inode *, off_t size, off_t offset);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
 int inode_open_cnt (const struct inode *);
+bool inode_is_removed (const struct inode *);
 void inode_lock (struct inode *);
 void inode_unlock (struct inode *);
 
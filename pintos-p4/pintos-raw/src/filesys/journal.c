@@ -0,0 +1,532 @@
+#include "filesys/journal.h"
+#include <bitmap.h>
+#include <debug.h>
+#include <hash.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Write-ahead journal for file system metadata.
+
+   Code that updates metadata (inodes, indirect blocks,
+   directories and the free map) brackets the update with
+   journal_begin() and journal_end().  The sectors it writes with
+   cache_write_meta() join the running transaction and are pinned
+   in the buffer cache, so that they cannot reach their home
+   locations yet.
+
+   All handles opened while a transaction is running belong to
+   it, so concurrent operations commit together.  Each handle
+   reserves room in the transaction for the sectors it may add
+   (its credits) when it is opened, waiting for a commit if there
+   is not enough, so a transaction never overflows: a metadata
+   sector that cannot be logged is a bug, and panics.  A commit waits
+   for the open handles to finish, appends the transaction's
+   sectors to a circular log region in a single multi-sector
+   write, and unpins them.  From then on the buffer cache writes
+   them back in place in its own time; that is the checkpoint.
+   The log's tail only moves, by flushing the cache, when the log
+   is running out of room or at shutdown.
+
+   At mount, journal_init() replays every intact transaction
+   between the tail and the end of the log, so metadata updates
+   are either completely on disk or not at all.  File data is not
+   journaled. */
+
+/* Identifies the journal's superblock. */
+#define JOURNAL_MAGIC 0x4a524e4c
+
+/* Identifies a transaction record in the log. */
+#define TXN_MAGIC 0x5458484e
+
+/* Number of sectors in the log region. */
+#define JOURNAL_SECTORS 128
+
+/* Most sectors in one transaction.  They stay pinned in the
+   buffer cache until the commit, so this must be well below
+   its size. */
+#define TXN_MAX 32
+
+/* Once a transaction has this many sectors, new handles wait for
+   it to commit. */
+#define TXN_OPEN_MAX (TXN_MAX / 2)
+
+/* Credits each handle reserves: enough for an inode, a sector of
+   directory data and the indirect blocks above it.  Operations
+   that may need more ask for it with journal_extend(). */
+#define HANDLE_CREDITS 8
+
+/* Journal superblock, stored in JOURNAL_SECTOR.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct journal_super
+  {
+    unsigned magic;                     /* JOURNAL_MAGIC. */
+    block_sector_t start;               /* First sector of the log. */
+    uint32_t size;                      /* Number of sectors in the log. */
+    uint32_t tail;                      /* Offset of oldest live record. */
+    uint32_t tail_seq;                  /* Sequence number of that record. */
+    uint8_t unused[492];                /* Not used. */
+  };
+
+/* Header sector of a transaction record.  The record's CNT
+   sectors follow it in the log.
+   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
+struct txn_header
+  {
+    unsigned magic;                     /* TXN_MAGIC. */
+    uint32_t seq;                       /* Sequence number. */
+    uint32_t cnt;                       /* Number of sectors. */
+    unsigned checksum;                  /* Hash of record, with this 0. */
+    block_sector_t sectors[TXN_MAX];    /* Home locations of sectors. */
+    uint8_t unused[BLOCK_SECTOR_SIZE - 16 - TXN_MAX * 4]; /* Not used. */
+  };
+
+static bool enabled;                    /* Does the disk have a journal? */
+static struct journal_super super;      /* In-memory superblock. */
+static uint32_t head;                   /* Offset for the next record. */
+static uint32_t seq;                    /* Running transaction's number. */
+
+/* Sectors in the running transaction. */
+static block_sector_t txn_sectors[TXN_MAX];
+static size_t txn_cnt;
+
+/* Protected by journal_lock. */
+static struct lock journal_lock;
+static struct condition journal_cond;   /* Signaled after each commit. */
+static int active;                      /* Number of open handles. */
+static bool commit_wanted;              /* Should the next chance commit? */
+static bool committing;                 /* Is a commit in progress? */
+static bool sealed;                     /* No more sectors may join. */
+static unsigned commit_cnt;             /* Number of commits so far. */
+static size_t reserved;                 /* Unused credits of open handles. */
+
+/* Room kept in every transaction for the free map's sectors,
+   which join it at commit. */
+static size_t map_credits;
+
+/* Sectors written to the log since it was last checkpointed.
+   Replay may still overwrite them, so the free map keeps them
+   from being reused until the next checkpoint. */
+static struct bitmap *logged;
+
+/* A transaction record being written or replayed. */
+static uint8_t record[(TXN_MAX + 1) * BLOCK_SECTOR_SIZE];
+
+/* Reserves the log region on a newly formatted disk and writes
+   an empty journal.  The free map must have been created. */
+void
+journal_create (void)
+{
+  static const uint8_t zeros[BLOCK_SECTOR_SIZE];
+  block_sector_t start;
+
+  ASSERT (sizeof (struct journal_super) == BLOCK_SECTOR_SIZE);
+  ASSERT (sizeof (struct txn_header) == BLOCK_SECTOR_SIZE);
+
+  if (free_map_allocate_run (JOURNAL_SECTORS, 0, 0, &start) != JOURNAL_SECTORS)
+    PANIC ("journal creation failed");
+
+  memset (&super, 0, sizeof super);
+  super.magic = JOURNAL_MAGIC;
+  super.start = start;
+  super.size = JOURNAL_SECTORS;
+  super.tail = 0;
+  super.tail_seq = 0;
+  block_write (fs_device, JOURNAL_SECTOR, &super);
+
+  /* Don't replay whatever an older file system left there. */
+  block_write (fs_device, start, zeros);
+}
+
+/* Reads the record with the running transaction's sequence
+   number at offset POS of the log into RECORD.  Returns true if
+   it is there and intact, false otherwise. */
+static bool
+read_record_at (uint32_t pos)
+{
+  struct txn_header *h = (struct txn_header *) record;
+  unsigned checksum;
+
+  if (pos >= super.size)
+    return false;
+  block_read (fs_device, super.start + pos, h);
+  if (h->magic != TXN_MAGIC || h->seq != seq
+      || h->cnt == 0 || h->cnt > TXN_MAX || pos + 1 + h->cnt > super.size)
+    return false;
+  block_read_multi (fs_device, super.start + pos + 1, h->cnt,
+                    record + BLOCK_SECTOR_SIZE);
+
+  checksum = h->checksum;
+  h->checksum = 0;
+  return hash_bytes (record, (h->cnt + 1) * BLOCK_SECTOR_SIZE) == checksum;
+}
+
+/* Reads the next record to replay into RECORD.  It is at offset
+   *POS, or at the start of the log if the log wrapped around
+   there, in which case *POS is updated.  Returns false if there
+   is no next record. */
+static bool
+read_record (uint32_t *pos)
+{
+  if (read_record_at (*pos))
+    return true;
+  if (*pos != 0 && read_record_at (0))
+    {
+      *pos = 0;
+      return true;
+    }
+  return false;
+}
+
+/* Mounts the journal, replaying any transactions that were
+   committed but not checkpointed before the system went down.
+   Must be called before the free map or any inode is read.
+   Disks formatted without a journal are used without one. */
+void
+journal_init (void)
+{
+  size_t replayed = 0;
+  uint32_t pos;
+
+  lock_init (&journal_lock);
+  cond_init (&journal_cond);
+  enabled = false;
+
+  block_read (fs_device, JOURNAL_SECTOR, &super);
+  if (super.magic != JOURNAL_MAGIC)
+    return;
+  map_credits = DIV_ROUND_UP (block_size (fs_device), BLOCK_SECTOR_SIZE * 8);
+  if (map_credits + HANDLE_CREDITS > TXN_MAX)
+    PANIC ("journal: file system device is too large");
+  logged = bitmap_create (block_size (fs_device));
+  if (logged == NULL)
+    PANIC ("journal creation failed--file system device is too large");
+
+  pos = super.tail;
+  seq = super.tail_seq;
+  while (read_record (&pos))
+    {
+      struct txn_header *h = (struct txn_header *) record;
+      size_t i;
+
+      for (i = 0; i < h->cnt; i++)
+        block_write (fs_device, h->sectors[i],
+                     record + (i + 1) * BLOCK_SECTOR_SIZE);
+      pos += h->cnt + 1;
+      seq++;
+      replayed++;
+    }
+  head = pos < super.size ? pos : 0;
+
+  if (replayed > 0)
+    {
+      printf ("journal: replayed %zu transactions\n", replayed);
+      super.tail = head;
+      super.tail_seq = seq;
+      block_write (fs_device, JOURNAL_SECTOR, &super);
+    }
+
+  txn_cnt = 0;
+  active = 0;
+  reserved = 0;
+  commit_wanted = committing = sealed = false;
+  commit_cnt = 0;
+  enabled = true;
+}
+
+/* Returns the number of log sectors between the tail and the
+   head. */
+static uint32_t
+log_used (void)
+{
+  return (head + super.size - super.tail) % super.size;
+}
+
+/* Appends the CNT sectors of the running transaction to the log
+   as one record, then lets the cache write them back. */
+static void
+write_record (size_t cnt)
+{
+  struct txn_header *h = (struct txn_header *) record;
+  size_t i;
+
+  /* Records do not wrap around the end of the log. */
+  if (head + cnt + 1 > super.size)
+    head = 0;
+
+  memset (h, 0, sizeof *h);
+  h->magic = TXN_MAGIC;
+  h->seq = seq;
+  h->cnt = cnt;
+  for (i = 0; i < cnt; i++)
+    {
+      h->sectors[i] = txn_sectors[i];
+      cache_read (txn_sectors[i], record + (i + 1) * BLOCK_SECTOR_SIZE);
+    }
+  h->checksum = hash_bytes (record, (cnt + 1) * BLOCK_SECTOR_SIZE);
+  block_write_multi (fs_device, super.start + head, cnt + 1, record);
+
+  head = (head + cnt + 1) % super.size;
+  seq++;
+
+  for (i = 0; i < cnt; i++)
+    {
+      bitmap_mark (logged, txn_sectors[i]);
+      cache_unpin (txn_sectors[i]);
+    }
+}
+
+/* Writes every committed sector back in place and empties the
+   log.  No handles may be open. */
+static void
+checkpoint (void)
+{
+  cache_flush ();
+  super.tail = head;
+  super.tail_seq = seq;
+  block_write (fs_device, JOURNAL_SECTOR, &super);
+
+  bitmap_set_all (logged, false);
+  free_map_release_deferred ();
+}
+
+/* Commits the running transaction, and checkpoints the log if
+   FORCE_CHECKPOINT is true or the log is running out of room.
+   journal_lock must be held, with no handles open and no commit
+   in progress.  The lock is released during the commit and held
+   again on return. */
+static void
+commit (bool force_checkpoint)
+{
+  struct thread *t = thread_current ();
+  size_t cnt;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (active == 0 && !committing);
+
+  committing = true;
+  lock_release (&journal_lock);
+
+  /* Bring the free map's changes into this transaction.  Writing
+     the free map opens nested handles, which must not wait for
+     this commit. */
+  t->journal_depth++;
+  free_map_flush ();
+  t->journal_depth--;
+
+  lock_acquire (&journal_lock);
+  sealed = true;
+  cnt = txn_cnt;
+  lock_release (&journal_lock);
+
+  if (cnt > 0)
+    write_record (cnt);
+  if (force_checkpoint || super.size - 1 - log_used () < 2 * (TXN_MAX + 1))
+    checkpoint ();
+
+  lock_acquire (&journal_lock);
+  txn_cnt = 0;
+  sealed = false;
+  commit_wanted = false;
+  committing = false;
+  commit_cnt++;
+  cond_broadcast (&journal_cond, &journal_lock);
+}
+
+/* Returns true if the running transaction can take CNT more
+   sectors on top of those added and reserved so far.
+   journal_lock must be held. */
+static bool
+has_room (size_t cnt)
+{
+  return txn_cnt + reserved + cnt + map_credits <= TXN_MAX;
+}
+
+/* Opens a handle on the running transaction, before updating
+   metadata, and reserves HANDLE_CREDITS sectors in it.  Handles
+   nest; only the outermost one counts.  May wait for a commit,
+   so it should be called before acquiring locks that other
+   handles need. */
+void
+journal_begin (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled || t->journal_depth++ > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing || commit_wanted || !has_room (HANDLE_CREDITS))
+    {
+      if (!committing && active == 0)
+        commit (false);
+      else
+        {
+          /* Have the last open handle commit. */
+          if (!committing)
+            commit_wanted = true;
+          cond_wait (&journal_cond, &journal_lock);
+        }
+    }
+  active++;
+  reserved += HANDLE_CREDITS;
+  t->journal_credits = HANDLE_CREDITS;
+  lock_release (&journal_lock);
+}
+
+/* Makes sure the current thread's handle has at least CNT
+   credits left, reserving more if the running transaction has
+   room for them.  Returns true if successful, false if the caller
+   must do without the update.  Never waits, so it may be called
+   with locks held. */
+bool
+journal_extend (size_t cnt)
+{
+  struct thread *t = thread_current ();
+  bool ok = true;
+
+  if (!enabled)
+    return true;
+  ASSERT (t->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  if (t->journal_credits < cnt)
+    {
+      size_t more = cnt - t->journal_credits;
+      ok = has_room (more);
+      if (ok)
+        {
+          reserved += more;
+          t->journal_credits = cnt;
+        }
+    }
+  lock_release (&journal_lock);
+  return ok;
+}
+
+/* Closes the handle opened by the matching journal_begin().  The
+   last handle to close commits the transaction if a commit has
+   been asked for. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled)
+    return;
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  reserved -= t->journal_credits;
+  t->journal_credits = 0;
+  if (--active == 0)
+    {
+      if (commit_wanted && !committing)
+        commit (false);
+      else
+        cond_broadcast (&journal_cond, &journal_lock);
+    }
+  lock_release (&journal_lock);
+}
+
+/* Commits the running transaction, as soon as its open handles
+   have finished, and waits for the commit.  Without a journal,
+   just writes the free map's changes into the buffer cache. */
+void
+journal_commit (void)
+{
+  unsigned cnt;
+
+  if (!enabled)
+    {
+      free_map_flush ();
+      return;
+    }
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (committing)
+    cond_wait (&journal_cond, &journal_lock);
+  cnt = commit_cnt;
+  commit_wanted = true;
+  while (commit_cnt == cnt)
+    {
+      if (active == 0 && !committing)
+        commit (false);
+      else
+        cond_wait (&journal_cond, &journal_lock);
+    }
+  lock_release (&journal_lock);
+}
+
+/* Commits and checkpoints everything and stops journaling, at
+   shutdown. */
+void
+journal_done (void)
+{
+  if (!enabled)
+    return;
+
+  lock_acquire (&journal_lock);
+  while (committing || active > 0)
+    cond_wait (&journal_cond, &journal_lock);
+  commit (true);
+  enabled = false;
+  lock_release (&journal_lock);
+
+  bitmap_destroy (logged);
+  logged = NULL;
+}
+
+/* Adds SECTOR, which the caller has just modified in the buffer
+   cache, to the running transaction, using one of the current
+   handle's credits, or the room kept for the free map if this is
+   the commit writing it.  Returns true if it was added; the
+   sector must then stay pinned in the cache until the journal
+   calls cache_unpin().  Returns false if there is no journal, in
+   which case the update is written back like file data. */
+bool
+journal_add (block_sector_t sector)
+{
+  struct thread *t = thread_current ();
+
+  if (!enabled)
+    return false;
+
+  lock_acquire (&journal_lock);
+  if (t->journal_depth == 0)
+    PANIC ("journal: sector %"PRDSNu" written without a handle", sector);
+  if (sealed)
+    PANIC ("journal: sector %"PRDSNu" written during a commit", sector);
+  if (t->journal_credits > 0)
+    {
+      t->journal_credits--;
+      reserved--;
+    }
+  else if (!committing)
+    PANIC ("journal: handle used more than its credits");
+  ASSERT (txn_cnt < TXN_MAX);
+
+  txn_sectors[txn_cnt++] = sector;
+  if (txn_cnt >= TXN_OPEN_MAX)
+    commit_wanted = true;
+  lock_release (&journal_lock);
+
+  return true;
+}
+
+/* Returns true if SECTOR is in the log and would be overwritten
+   if the log were replayed now. */
+bool
+journal_logged (block_sector_t sector)
+{
+  return enabled && bitmap_test (logged, sector);
+}
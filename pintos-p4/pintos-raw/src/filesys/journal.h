@@ -0,0 +1,20 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "devices/block.h"
+
+void journal_create (void);
+void journal_init (void);
+void journal_done (void);
+
+void journal_begin (void);
+void journal_end (void);
+bool journal_extend (size_t cnt);
+void journal_commit (void);
+
+bool journal_add (block_sector_t);
+bool journal_logged (block_sector_t);
+
+#endif /* filesys/journal.h */
@@ -0,0 +1,19 @@
+#ifndef __LIB_DIRENT_H
+#define __LIB_DIRENT_H
+
+#include <stdbool.h>
+
+/* Longest name in a directory entry.  Same as NAME_MAX in
+   filesys/directory.h. */
+#define DIRENT_NAME_MAX 14
+
+/* A directory entry, as returned by the getdents system call. */
+struct dirent
+  {
+    int inumber;                        /* Inode number. */
+    bool is_dir;                        /* Directory or file? */
+    unsigned length;                    /* Size in bytes. */
+    char name[DIRENT_NAME_MAX + 1];     /* Null-terminated name. */
+  };
+
+#endif /* lib/dirent.h */
@@ -0,0 +1,14 @@
+#ifndef __LIB_UIO_H
+#define __LIB_UIO_H
+
+/* Most buffers that one readv or writev system call accepts. */
+#define IOV_MAX 64
+
+/* One buffer of a readv or writev system call. */
+struct iovec
+  {
+    void *iov_base;                     /* Start of the buffer. */
+    unsigned iov_len;                   /* Size in bytes. */
+  };
+
+#endif /* lib/uio.h */
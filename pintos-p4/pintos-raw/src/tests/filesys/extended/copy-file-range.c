@@ -0,0 +1,69 @@
+/* Copies one file into another with copy_file_range, first part
+   of it and then the rest with a request that runs past the end
+   of the source, which must come up short.  Each copy must
+   advance both files' positions.  A copy between overlapping
+   ranges of the same file must fail. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1000];
+
+void
+test_main (void)
+{
+  int src, dst, src2, retval;
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = 'a' + i % 26;
+
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK (write (src, buf, sizeof buf) == sizeof buf, "write \"src\"");
+  msg ("seek \"src\" to 0");
+  seek (src, 0);
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+
+  retval = copy_file_range (src, dst, 600);
+  CHECK (retval == 600, "copy 600 bytes (must return 600, actually %d)",
+         retval);
+  retval = tell (src);
+  CHECK (retval == 600, "tell \"src\" (must return 600, actually %d)", retval);
+  retval = tell (dst);
+  CHECK (retval == 600, "tell \"dst\" (must return 600, actually %d)", retval);
+
+  retval = copy_file_range (src, dst, 600);
+  CHECK (retval == 400, "copy 600 more bytes (must return 400, actually %d)",
+         retval);
+  retval = tell (src);
+  CHECK (retval == 1000, "tell \"src\" (must return 1000, actually %d)",
+         retval);
+  retval = tell (dst);
+  CHECK (retval == 1000, "tell \"dst\" (must return 1000, actually %d)",
+         retval);
+
+  retval = copy_file_range (src, dst, 100);
+  CHECK (retval == 0, "copy at end of \"src\" (must return 0, actually %d)",
+         retval);
+
+  CHECK ((src2 = open ("src")) > 1, "open \"src\" again");
+  msg ("seek \"src\" to 0 and the second \"src\" to 100");
+  seek (src, 0);
+  seek (src2, 100);
+  retval = copy_file_range (src, src2, 200);
+  CHECK (retval == -1, "copy onto overlapping range (must return -1, actually %d)",
+         retval);
+  retval = tell (src);
+  CHECK (retval == 0, "tell \"src\" (must return 0, actually %d)", retval);
+
+  msg ("close all files");
+  close (src);
+  close (src2);
+  close (dst);
+
+  check_file ("src", buf, sizeof buf);
+  check_file ("dst", buf, sizeof buf);
+}
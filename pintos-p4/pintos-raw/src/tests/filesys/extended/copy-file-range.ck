@@ -0,0 +1,33 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(copy-file-range) begin
+(copy-file-range) create "src"
+(copy-file-range) open "src"
+(copy-file-range) write "src"
+(copy-file-range) seek "src" to 0
+(copy-file-range) create "dst"
+(copy-file-range) open "dst"
+(copy-file-range) copy 600 bytes (must return 600, actually 600)
+(copy-file-range) tell "src" (must return 600, actually 600)
+(copy-file-range) tell "dst" (must return 600, actually 600)
+(copy-file-range) copy 600 more bytes (must return 400, actually 400)
+(copy-file-range) tell "src" (must return 1000, actually 1000)
+(copy-file-range) tell "dst" (must return 1000, actually 1000)
+(copy-file-range) copy at end of "src" (must return 0, actually 0)
+(copy-file-range) open "src" again
+(copy-file-range) seek "src" to 0 and the second "src" to 100
+(copy-file-range) copy onto overlapping range (must return -1, actually -1)
+(copy-file-range) tell "src" (must return 0, actually 0)
+(copy-file-range) close all files
+(copy-file-range) open "src" for verification
+(copy-file-range) verified contents of "src"
+(copy-file-range) close "src"
+(copy-file-range) open "dst" for verification
+(copy-file-range) verified contents of "dst"
+(copy-file-range) close "dst"
+(copy-file-range) end
+EOF
+pass;
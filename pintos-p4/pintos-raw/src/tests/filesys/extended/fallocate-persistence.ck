@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => ["a" x 100 . "b" x 1500 . "\0" x 3400]});
+pass;
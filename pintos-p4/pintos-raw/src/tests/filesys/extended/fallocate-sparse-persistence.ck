@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+# The 62 extents of an inode hold 31 one-byte writes and the 30
+# holes between them.  The 32nd write fails, but its offset still
+# becomes the file's length.
+my ($data) = "\0" x (31 * 2048);
+substr ($data, $_ * 2048, 1) = "a" foreach 0...30;
+check_archive ({"sparse" => [$data]});
+pass;
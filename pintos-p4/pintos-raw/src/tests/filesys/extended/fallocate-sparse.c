@@ -0,0 +1,62 @@
+/* Writes one byte every four sectors of a file until a write
+   fails, which fills its extent table with alternating data
+   extents and holes.  Then reserves a sector in the middle of a
+   hole with fallocate.  Writing that sector needs two more
+   extents than are left, so the write must fail, and must keep
+   failing the same way when tried again, rather than take the
+   reserved sector twice.  Runs on a file system formatted with
+   -extents. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define STRIDE (4 * 512)
+
+/* Most writes tried; the table fills long before. */
+#define MAX_WRITES 64
+
+static char buf[MAX_WRITES * STRIDE];
+static char sector[512];
+
+void
+test_main (void)
+{
+  const char *file_name = "sparse";
+  int fd, retval, size, i;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  msg ("write a byte every %d bytes until a write fails", STRIDE);
+  for (i = 0; i < MAX_WRITES; i++)
+    {
+      seek (fd, i * STRIDE);
+      if (write (fd, "a", 1) != 1)
+        break;
+      buf[i * STRIDE] = 'a';
+    }
+  if (i == MAX_WRITES)
+    fail ("%d writes did not fill the extent table", MAX_WRITES);
+
+  size = filesize (fd);
+  if (size <= (i - 1) * STRIDE || size > (int) sizeof buf)
+    fail ("filesize returned %d after %d writes", size, i);
+
+  CHECK (fallocate (fd, STRIDE + 1024, 512),
+         "fallocate the middle sector of the first hole");
+
+  seek (fd, STRIDE + 1024);
+  retval = write (fd, sector, sizeof sector);
+  CHECK (retval == 0, "write reserved sector (must return 0, actually %d)",
+         retval);
+  seek (fd, STRIDE + 1024);
+  retval = write (fd, sector, sizeof sector);
+  CHECK (retval == 0, "write it again (must return 0, actually %d)",
+         retval);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, size);
+}
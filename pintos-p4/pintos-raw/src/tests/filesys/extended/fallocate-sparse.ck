@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fallocate-sparse) begin
+(fallocate-sparse) create "sparse"
+(fallocate-sparse) open "sparse"
+(fallocate-sparse) write a byte every 2048 bytes until a write fails
+(fallocate-sparse) fallocate the middle sector of the first hole
+(fallocate-sparse) write reserved sector (must return 0, actually 0)
+(fallocate-sparse) write it again (must return 0, actually 0)
+(fallocate-sparse) close "sparse"
+(fallocate-sparse) open "sparse" for verification
+(fallocate-sparse) verified contents of "sparse"
+(fallocate-sparse) close "sparse"
+(fallocate-sparse) end
+EOF
+pass;
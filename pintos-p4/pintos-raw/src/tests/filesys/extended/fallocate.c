@@ -0,0 +1,42 @@
+/* Reserves space past the end of a file with fallocate, which
+   must extend the file without moving its position, then writes
+   into part of the reserved range and closes the file with the
+   rest of the reservation unused.  Bytes never written must read
+   as zeros. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[5000];
+
+void
+test_main (void)
+{
+  const char *file_name = "testfile";
+  int fd, retval;
+
+  memset (buf, 'a', 100);
+  memset (buf + 100, 'b', 1500);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, 100) == 100, "write 100 bytes to \"%s\"", file_name);
+
+  CHECK (fallocate (fd, 1000, 4000), "fallocate bytes 1000...4999");
+  retval = filesize (fd);
+  CHECK (retval == 5000, "filesize (must return 5000, actually %d)", retval);
+  retval = tell (fd);
+  CHECK (retval == 100, "tell (must return 100, actually %d)", retval);
+
+  CHECK (write (fd, buf + 100, 1500) == 1500,
+         "write 1500 bytes into reserved space");
+  retval = filesize (fd);
+  CHECK (retval == 5000, "filesize (must return 5000, actually %d)", retval);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, sizeof buf);
+}
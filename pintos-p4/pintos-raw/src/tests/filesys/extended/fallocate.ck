@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fallocate) begin
+(fallocate) create "testfile"
+(fallocate) open "testfile"
+(fallocate) write 100 bytes to "testfile"
+(fallocate) fallocate bytes 1000...4999
+(fallocate) filesize (must return 5000, actually 5000)
+(fallocate) tell (must return 100, actually 100)
+(fallocate) write 1500 bytes into reserved space
+(fallocate) filesize (must return 5000, actually 5000)
+(fallocate) close "testfile"
+(fallocate) open "testfile" for verification
+(fallocate) verified contents of "testfile"
+(fallocate) close "testfile"
+(fallocate) end
+EOF
+pass;
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+my ($fs);
+foreach my $i (0...59) {
+    if ($i % 5 == 0) {
+	$fs->{'x'}{"d$i"} = {};
+    } else {
+	$fs->{'x'}{"f$i"} = ["\0" x $i];
+    }
+}
+$fs->{'x'}{"n$_"} = ["\0" x $_] foreach 0...99;
+$fs->{'x'}{"m$_"} = ["\0" x $_] foreach 0...99;
+check_archive ($fs);
+pass;
@@ -0,0 +1,175 @@
+/* Lists a directory with getdents, a few entries per call, and
+   checks each entry's name, inode number, type and length.
+   After the first call, creates enough files to split the
+   directory's buckets, which must not make the listing skip or
+   repeat any entry that was there all along.  Then lists it
+   again the same way, alternating readdir and getdents on one
+   fd, which must share a single position. */
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Entries created before the first listing, and during each
+   listing. */
+#define OLD_CNT 60
+#define NEW_CNT 100
+
+/* Entries asked for per call. */
+#define BATCH 8
+
+static int seen[OLD_CNT + 2 * NEW_CNT];
+
+/* Counts NAME as returned by the listing, failing if it was
+   already. */
+static void
+mark_seen (const char *name)
+{
+  int i;
+
+  if (name[0] == 'd' || name[0] == 'f')
+    i = atoi (name + 1);
+  else if (name[0] == 'n')
+    i = OLD_CNT + atoi (name + 1);
+  else if (name[0] == 'm')
+    i = OLD_CNT + NEW_CNT + atoi (name + 1);
+  else
+    fail ("unexpected entry \"%s\"", name);
+  if (i < 0 || i >= OLD_CNT + 2 * NEW_CNT)
+    fail ("unexpected entry \"%s\"", name);
+  if (++seen[i] > 1)
+    fail ("\"%s\" returned twice", name);
+}
+
+/* Checks entry D returned by getdents. */
+static void
+check_entry (const struct dirent *d)
+{
+  char name[32];
+  int fd;
+
+  mark_seen (d->name);
+
+  snprintf (name, sizeof name, "/x/%s", d->name);
+  fd = open (name);
+  if (fd < 2)
+    fail ("open \"%s\"", name);
+  if (d->inumber != inumber (fd))
+    fail ("\"%s\" has inumber %d, should be %d",
+          d->name, d->inumber, inumber (fd));
+  if (d->is_dir != isdir (fd))
+    fail ("\"%s\" has is_dir %d, should be %d",
+          d->name, d->is_dir, isdir (fd));
+  if (!d->is_dir && d->length != (unsigned) filesize (fd))
+    fail ("\"%s\" has length %u, should be %d",
+          d->name, d->length, filesize (fd));
+  close (fd);
+}
+
+/* Creates NEW_CNT files in "/x" named PREFIX followed by a
+   number. */
+static void
+create_files (char prefix)
+{
+  char name[32];
+  int i;
+
+  msg ("create %d more files in \"/x\"", NEW_CNT);
+  for (i = 0; i < NEW_CNT; i++)
+    {
+      snprintf (name, sizeof name, "/x/%c%d", prefix, i);
+      if (!create (name, i))
+        fail ("create \"%s\"", name);
+    }
+}
+
+/* Fails unless every entry made before the listing, the first
+   CNT entries of seen[], was returned exactly once. */
+static void
+check_seen (int cnt)
+{
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    if (seen[i] != 1)
+      fail ("entry %d returned %d times", i, seen[i]);
+  msg ("every entry returned once");
+}
+
+void
+test_main (void)
+{
+  struct dirent entries[BATCH];
+  char name[READDIR_MAX_LEN + 1];
+  int fd, n, i;
+
+  CHECK (mkdir ("/x"), "mkdir \"/x\"");
+  msg ("create %d entries in \"/x\"", OLD_CNT);
+  for (i = 0; i < OLD_CNT; i++)
+    if (i % 5 == 0)
+      {
+        snprintf (name, sizeof name, "/x/d%d", i);
+        if (!mkdir (name))
+          fail ("mkdir \"%s\"", name);
+      }
+    else
+      {
+        snprintf (name, sizeof name, "/x/f%d", i);
+        if (!create (name, i))
+          fail ("create \"%s\"", name);
+      }
+
+  /* List with getdents alone. */
+  CHECK ((fd = open ("/x")) > 1, "open \"/x\"");
+  n = getdents (fd, entries, BATCH);
+  CHECK (n == BATCH, "getdents \"/x\" (must return %d, actually %d)",
+         BATCH, n);
+  for (i = 0; i < n; i++)
+    check_entry (&entries[i]);
+
+  create_files ('n');
+
+  msg ("getdents \"/x\" to the end");
+  while ((n = getdents (fd, entries, BATCH)) > 0)
+    for (i = 0; i < n; i++)
+      check_entry (&entries[i]);
+  CHECK (n == 0, "getdents at end (must return 0, actually %d)", n);
+  check_seen (OLD_CNT);
+  close (fd);
+
+  /* List with readdir and getdents in turn. */
+  memset (seen, 0, sizeof seen);
+  CHECK ((fd = open ("/x")) > 1, "open \"/x\" again");
+  CHECK (readdir (fd, name), "readdir \"/x\"");
+  mark_seen (name);
+  n = getdents (fd, entries, BATCH);
+  CHECK (n == BATCH, "getdents \"/x\" (must return %d, actually %d)",
+         BATCH, n);
+  for (i = 0; i < n; i++)
+    check_entry (&entries[i]);
+
+  create_files ('m');
+
+  msg ("readdir and getdents \"/x\" in turn to the end");
+  while (readdir (fd, name))
+    {
+      mark_seen (name);
+      n = getdents (fd, entries, BATCH);
+      for (i = 0; i < n; i++)
+        check_entry (&entries[i]);
+    }
+  n = getdents (fd, entries, BATCH);
+  CHECK (n == 0, "getdents at end (must return 0, actually %d)", n);
+  check_seen (OLD_CNT + NEW_CNT);
+  close (fd);
+
+  CHECK ((fd = open ("/x/f1")) > 1, "open \"/x/f1\"");
+  n = getdents (fd, entries, BATCH);
+  CHECK (n == -1, "getdents \"/x/f1\" (must return -1, actually %d)", n);
+  msg ("close \"/x/f1\"");
+  close (fd);
+}
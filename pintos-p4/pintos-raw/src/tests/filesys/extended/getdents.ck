@@ -0,0 +1,27 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(getdents) begin
+(getdents) mkdir "/x"
+(getdents) create 60 entries in "/x"
+(getdents) open "/x"
+(getdents) getdents "/x" (must return 8, actually 8)
+(getdents) create 100 more files in "/x"
+(getdents) getdents "/x" to the end
+(getdents) getdents at end (must return 0, actually 0)
+(getdents) every entry returned once
+(getdents) open "/x" again
+(getdents) readdir "/x"
+(getdents) getdents "/x" (must return 8, actually 8)
+(getdents) create 100 more files in "/x"
+(getdents) readdir and getdents "/x" in turn to the end
+(getdents) getdents at end (must return 0, actually 0)
+(getdents) every entry returned once
+(getdents) open "/x/f1"
+(getdents) getdents "/x/f1" (must return -1, actually -1)
+(getdents) close "/x/f1"
+(getdents) end
+EOF
+pass;
@@ -0,0 +1,7 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => ["a" x 500 . "b" x 300 . "a" x 200
+			       . "\0" x 200 . "c" x 100]});
+pass;
@@ -0,0 +1,68 @@
+/* Writes and reads at given offsets with pwrite and pread,
+   which must leave the file position where it was.  pread must
+   stop at the end of the file, and pwrite past it must grow the
+   file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[1300];
+static char data[300];
+
+void
+test_main (void)
+{
+  const char *file_name = "testfile";
+  int fd, retval, i;
+
+  memset (buf, 'a', 1000);
+  memset (buf + 500, 'b', 300);
+  memset (buf + 1200, 'c', 100);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  memset (data, 'a', sizeof data);
+  for (i = 0; i < 1000; i += 250)
+    if (write (fd, data, 250) != 250)
+      fail ("write \"%s\"", file_name);
+  msg ("write 1000 bytes to \"%s\"", file_name);
+  msg ("seek \"%s\" to 100", file_name);
+  seek (fd, 100);
+
+  retval = pwrite (fd, buf + 500, 300, 500);
+  CHECK (retval == 300, "pwrite 300 bytes at 500 (must return 300, actually %d)",
+         retval);
+  retval = tell (fd);
+  CHECK (retval == 100, "tell (must return 100, actually %d)", retval);
+
+  memset (data, 0, sizeof data);
+  retval = pread (fd, data, 300, 500);
+  CHECK (retval == 300, "pread 300 bytes at 500 (must return 300, actually %d)",
+         retval);
+  compare_bytes (data, buf + 500, 300, 500, file_name);
+  retval = tell (fd);
+  CHECK (retval == 100, "tell (must return 100, actually %d)", retval);
+
+  retval = pread (fd, data, 100, 1000);
+  CHECK (retval == 0, "pread at end of file (must return 0, actually %d)",
+         retval);
+  retval = pread (fd, data, 100, 950);
+  CHECK (retval == 50, "pread across end of file (must return 50, actually %d)",
+         retval);
+  compare_bytes (data, buf + 950, 50, 950, file_name);
+
+  retval = pwrite (fd, buf + 1200, 100, 1200);
+  CHECK (retval == 100, "pwrite past end of file (must return 100, actually %d)",
+         retval);
+  retval = filesize (fd);
+  CHECK (retval == 1300, "filesize (must return 1300, actually %d)", retval);
+  retval = tell (fd);
+  CHECK (retval == 100, "tell (must return 100, actually %d)", retval);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "testfile"
+(pread-pwrite) open "testfile"
+(pread-pwrite) write 1000 bytes to "testfile"
+(pread-pwrite) seek "testfile" to 100
+(pread-pwrite) pwrite 300 bytes at 500 (must return 300, actually 300)
+(pread-pwrite) tell (must return 100, actually 100)
+(pread-pwrite) pread 300 bytes at 500 (must return 300, actually 300)
+(pread-pwrite) tell (must return 100, actually 100)
+(pread-pwrite) pread at end of file (must return 0, actually 0)
+(pread-pwrite) pread across end of file (must return 50, actually 50)
+(pread-pwrite) pwrite past end of file (must return 100, actually 100)
+(pread-pwrite) filesize (must return 1300, actually 1300)
+(pread-pwrite) tell (must return 100, actually 100)
+(pread-pwrite) close "testfile"
+(pread-pwrite) open "testfile" for verification
+(pread-pwrite) verified contents of "testfile"
+(pread-pwrite) close "testfile"
+(pread-pwrite) end
+EOF
+pass;
@@ -0,0 +1,20 @@
+/* Passes an invalid pointer to the readv system call as the
+   array of buffers.  The process must be terminated with -1
+   exit code. */
+
+#include <syscall.h>
+#include <uio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  int fd;
+
+  CHECK (create ("testfile", 0), "create \"testfile\"");
+  CHECK ((fd = open ("testfile")) > 1, "open \"testfile\"");
+
+  readv (fd, (struct iovec *) 0xc0100000, 1);
+  fail ("should not have survived readv()");
+}
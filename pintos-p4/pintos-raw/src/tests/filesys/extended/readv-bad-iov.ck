@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(readv-bad-iov) begin
+(readv-bad-iov) create "testfile"
+(readv-bad-iov) open "testfile"
+readv-bad-iov: exit(-1)
+EOF
+pass;
@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"testfile" => ["x" x 10 . "y" x 200 . "z" x 50]});
+pass;
@@ -0,0 +1,69 @@
+/* Writes three buffers with one writev and reads them back into
+   buffers of other sizes with one readv, which must split the
+   data across them in order and stop at the end of the file.
+   Both must fail for more than IOV_MAX buffers. */
+
+#include <string.h>
+#include <syscall.h>
+#include <uio.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf[260];
+static char data[300];
+static struct iovec too_many[IOV_MAX + 1];
+
+void
+test_main (void)
+{
+  const char *file_name = "testfile";
+  struct iovec iov[3];
+  int fd, retval;
+
+  memset (buf, 'x', 10);
+  memset (buf + 10, 'y', 200);
+  memset (buf + 210, 'z', 50);
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+
+  iov[0].iov_base = buf;
+  iov[0].iov_len = 10;
+  iov[1].iov_base = buf + 10;
+  iov[1].iov_len = 200;
+  iov[2].iov_base = buf + 210;
+  iov[2].iov_len = 50;
+  retval = writev (fd, iov, 3);
+  CHECK (retval == 260, "writev 10+200+50 bytes (must return 260, actually %d)",
+         retval);
+  retval = tell (fd);
+  CHECK (retval == 260, "tell (must return 260, actually %d)", retval);
+
+  msg ("seek \"%s\" to 0", file_name);
+  seek (fd, 0);
+  iov[0].iov_base = data;
+  iov[0].iov_len = 100;
+  iov[1].iov_base = data + 100;
+  iov[1].iov_len = 100;
+  iov[2].iov_base = data + 200;
+  iov[2].iov_len = 100;
+  retval = readv (fd, iov, 3);
+  CHECK (retval == 260, "readv 100+100+100 bytes (must return 260, actually %d)",
+         retval);
+  compare_bytes (data, buf, 260, 0, file_name);
+  retval = readv (fd, iov, 3);
+  CHECK (retval == 0, "readv at end of file (must return 0, actually %d)",
+         retval);
+
+  retval = writev (fd, too_many, IOV_MAX + 1);
+  CHECK (retval == -1, "writev %d buffers (must return -1, actually %d)",
+         IOV_MAX + 1, retval);
+  retval = readv (fd, too_many, IOV_MAX + 1);
+  CHECK (retval == -1, "readv %d buffers (must return -1, actually %d)",
+         IOV_MAX + 1, retval);
+
+  msg ("close \"%s\"", file_name);
+  close (fd);
+
+  check_file (file_name, buf, sizeof buf);
+}
@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "testfile"
+(readv-writev) open "testfile"
+(readv-writev) writev 10+200+50 bytes (must return 260, actually 260)
+(readv-writev) tell (must return 260, actually 260)
+(readv-writev) seek "testfile" to 0
+(readv-writev) readv 100+100+100 bytes (must return 260, actually 260)
+(readv-writev) readv at end of file (must return 0, actually 0)
+(readv-writev) writev 65 buffers (must return -1, actually -1)
+(readv-writev) readv 65 buffers (must return -1, actually -1)
+(readv-writev) close "testfile"
+(readv-writev) open "testfile" for verification
+(readv-writev) verified contents of "testfile"
+(readv-writev) close "testfile"
+(readv-writev) end
+EOF
+pass;
@@ -0,0 +1,61 @@
+/* Creates several threads that each acquire a reader/writer lock
+   for reading, and checks that all of them hold it at once and
+   that a writer can get in only after all of them are gone. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+#define READER_CNT 3
+
+static thread_func reader_thread;
+static struct rwlock rw;
+static struct semaphore in, go, done;
+
+void
+test_rwlock_readers (void) 
+{
+  int i;
+
+  rwlock_init (&rw);
+  sema_init (&in, 0);
+  sema_init (&go, 0);
+  sema_init (&done, 0);
+
+  for (i = 0; i < READER_CNT; i++) 
+    {
+      char name[16];
+      snprintf (name, sizeof name, "reader %d", i);
+      thread_create (name, PRI_DEFAULT, reader_thread, NULL);
+    }
+
+  /* Each reader ups IN once it holds the lock, then waits for
+     GO, so all of them hold it when this loop finishes. */
+  for (i = 0; i < READER_CNT; i++)
+    sema_down (&in);
+  msg ("%d readers hold the lock at once.", READER_CNT);
+  if (rwlock_try_acquire_write (&rw))
+    fail ("Writer got in while readers hold the lock.");
+  msg ("Writer refused.");
+
+  for (i = 0; i < READER_CNT; i++)
+    sema_up (&go);
+  for (i = 0; i < READER_CNT; i++)
+    sema_down (&done);
+  if (!rwlock_try_acquire_write (&rw))
+    fail ("Writer refused after readers left.");
+  msg ("Writer got in after readers left.");
+  rwlock_release_write (&rw);
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  rwlock_acquire_read (&rw);
+  sema_up (&in);
+  sema_down (&go);
+  rwlock_release_read (&rw);
+  sema_up (&done);
+}
@@ -0,0 +1,38 @@
+/* Checks the try-variants of reader/writer locks from a single
+   thread: any number of shared holders, but an exclusive holder
+   only when there are no others. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/synch.h"
+
+void
+test_rwlock_try (void) 
+{
+  struct rwlock rw;
+
+  rwlock_init (&rw);
+
+  ASSERT (rwlock_try_acquire_read (&rw));
+  ASSERT (rwlock_try_acquire_read (&rw));
+  msg ("Held for reading twice.");
+  ASSERT (!rwlock_try_acquire_write (&rw));
+  msg ("Writing refused while held for reading.");
+  rwlock_release_read (&rw);
+  ASSERT (!rwlock_try_acquire_write (&rw));
+  rwlock_release_read (&rw);
+
+  ASSERT (rwlock_try_acquire_write (&rw));
+  ASSERT (rwlock_held_for_write (&rw));
+  msg ("Held for writing.");
+  ASSERT (!rwlock_try_acquire_read (&rw));
+  msg ("Reading refused while held for writing.");
+  rwlock_release_write (&rw);
+  ASSERT (!rwlock_held_for_write (&rw));
+
+  rwlock_acquire_read (&rw);
+  rwlock_release_read (&rw);
+  rwlock_acquire_write (&rw);
+  rwlock_release_write (&rw);
+  msg ("Acquired and released again.");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-try) begin
+(rwlock-try) Held for reading twice.
+(rwlock-try) Writing refused while held for reading.
+(rwlock-try) Held for writing.
+(rwlock-try) Reading refused while held for writing.
+(rwlock-try) Acquired and released again.
+(rwlock-try) end
+EOF
+pass;
@@ -0,0 +1,68 @@
+/* Checks that reader/writer locks prefer writers.  While the
+   main thread holds the lock for reading, a writer starts
+   waiting for it; new readers must then wait behind the writer
+   instead of joining the main thread, and the writer must get in
+   as soon as the main thread lets go. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+static thread_func writer_thread;
+static thread_func reader_thread;
+static struct rwlock rw;
+static struct semaphore started, done;
+
+void
+test_rwlock_writer (void) 
+{
+  int i;
+
+  rwlock_init (&rw);
+  sema_init (&started, 0);
+  sema_init (&done, 0);
+
+  rwlock_acquire_read (&rw);
+
+  /* Let the writer run until it is waiting for the lock, which
+     shows as a new reader being refused.  Until then a new
+     reader still gets in, so let go of it right away. */
+  thread_create ("writer", PRI_DEFAULT, writer_thread, NULL);
+  for (i = 0; rwlock_try_acquire_read (&rw); i++)
+    {
+      rwlock_release_read (&rw);
+      if (i >= 1000)
+        fail ("New readers still got in after 1000 yields.");
+      thread_yield ();
+    }
+  msg ("New reader refused while a writer waits.");
+
+  thread_create ("reader", PRI_DEFAULT, reader_thread, NULL);
+  sema_down (&started);
+  msg ("Main thread releasing the lock.");
+  rwlock_release_read (&rw);
+
+  sema_down (&done);
+  sema_down (&done);
+}
+
+static void
+writer_thread (void *aux UNUSED) 
+{
+  rwlock_acquire_write (&rw);
+  msg ("Writer got the lock.");
+  rwlock_release_write (&rw);
+  sema_up (&done);
+}
+
+static void
+reader_thread (void *aux UNUSED) 
+{
+  sema_up (&started);
+  rwlock_acquire_read (&rw);
+  msg ("Reader got the lock.");
+  rwlock_release_read (&rw);
+  sema_up (&done);
+}
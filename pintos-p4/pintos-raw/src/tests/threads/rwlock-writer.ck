@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(rwlock-writer) begin
+(rwlock-writer) New reader refused while a writer waits.
+(rwlock-writer) Main thread releasing the lock.
+(rwlock-writer) Writer got the lock.
+(rwlock-writer) Reader got the lock.
+(rwlock-writer) end
+EOF
+pass;
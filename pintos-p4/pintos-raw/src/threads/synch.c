@@ -336,3 +336,164 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Initializes RW, a reader/writer lock.  Any number of threads
+   may hold it for reading ("shared") at once, or a single thread
+   may hold it for writing ("exclusive").
+
+   Writers are preferred: once a writer is waiting, new readers
+   wait behind it, so a steady stream of readers cannot starve
+   writers.  Readers that arrive while writers come and go still
+   get in between them, because all waiting readers are woken
+   each time the last writer leaves.
+
+   The exclusive holder owns RW->writer, an ordinary lock, for
+   as long as it holds RW, and writers queue for the lock one at
+   a time.  A thread that waits for RW behind a writer therefore
+   waits on a lock whose holder is known, which is what priority
+   donation needs; shared holders are not recorded, so a writer
+   waiting for readers to leave cannot donate to them.
+
+   Like locks, reader/writer locks are not recursive, and a
+   holder must not try to upgrade from shared to exclusive. */
+void
+rwlock_init (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  cond_init (&rw->readers_ok);
+  cond_init (&rw->writers_ok);
+  rw->readers = 0;
+  rw->writers = 0;
+  lock_init (&rw->writer);
+}
+
+/* Acquires RW for reading, sleeping while a writer holds it or
+   is waiting for it.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (&rw->writer));
+
+  lock_acquire (&rw->lock);
+  while (rw->writers > 0)
+    cond_wait (&rw->readers_ok, &rw->lock);
+  rw->readers++;
+  lock_release (&rw->lock);
+}
+
+/* Tries to acquire RW for reading and returns true if
+   successful, or false if a writer holds it or is waiting for
+   it.  Does not wait for other holders, but must not be called
+   within an interrupt handler. */
+bool
+rwlock_try_acquire_read (struct rwlock *rw)
+{
+  bool success;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (&rw->writer));
+
+  lock_acquire (&rw->lock);
+  success = rw->writers == 0;
+  if (success)
+    rw->readers++;
+  lock_release (&rw->lock);
+  return success;
+}
+
+/* Releases RW, which the current thread holds for reading.  The
+   last reader out wakes the writer waiting for it, if any. */
+void
+rwlock_release_read (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+
+  lock_acquire (&rw->lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0)
+    cond_signal (&rw->writers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Acquires RW for writing, sleeping until every other holder has
+   released it.  New readers are kept out from the moment this
+   function is called.
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+void
+rwlock_acquire_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (&rw->writer));
+
+  lock_acquire (&rw->lock);
+  rw->writers++;
+  lock_release (&rw->lock);
+
+  /* Wait for earlier writers, then for the readers. */
+  lock_acquire (&rw->writer);
+  lock_acquire (&rw->lock);
+  while (rw->readers > 0)
+    cond_wait (&rw->writers_ok, &rw->lock);
+  lock_release (&rw->lock);
+}
+
+/* Tries to acquire RW for writing and returns true if
+   successful, or false if any other thread holds it or is
+   waiting for it.  Does not wait for other holders, but must not
+   be called within an interrupt handler. */
+bool
+rwlock_try_acquire_write (struct rwlock *rw)
+{
+  bool success;
+
+  ASSERT (rw != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (&rw->writer));
+
+  lock_acquire (&rw->lock);
+  success = (rw->writers == 0 && rw->readers == 0
+             && lock_try_acquire (&rw->writer));
+  if (success)
+    rw->writers++;
+  lock_release (&rw->lock);
+  return success;
+}
+
+/* Releases RW, which the current thread holds for writing.  The
+   next waiting writer goes next; if there is none, all waiting
+   readers are woken. */
+void
+rwlock_release_write (struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_acquire (&rw->lock);
+  if (--rw->writers == 0)
+    cond_broadcast (&rw->readers_ok, &rw->lock);
+  lock_release (&rw->lock);
+  lock_release (&rw->writer);
+}
+
+/* Returns true if the current thread holds RW for writing, false
+   otherwise.  Shared holders are not recorded, so there is no
+   way to ask the same about reading. */
+bool
+rwlock_held_for_write (const struct rwlock *rw)
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->writer);
+}
@@ -125,6 +125,8 @@ struct thread
 
     //#####PROJECT 4 current workign directory implementation
     struct dir* cwd;
+    int journal_depth;                  /* Nested journal handles. */
+    size_t journal_credits;             /* Sectors its handle may add. */
   };
 
 /* If false (default), use round-robin scheduler.
@@ -23,6 +23,7 @@ static void copy_in (void *dst_, const void *usrc_, size_t size);
 static char* copy_in_string (const char *us);
 static inline bool get_user (uint8_t *dst, const uint8_t *usrc);
 static inline bool put_user (uint8_t *udst, uint8_t byte);
+static bool copy_out (void *udst_, const void *src_, size_t size);
 void exit(int status);
 struct file* get_file_by_fd(int fd);
 struct dir* get_dir_by_fd(int fd);
@@ -86,9 +87,10 @@ struct dir* get_dir_by_fd(int fd){
   return NULL;
 }
 
-//init syscall, also init lock here
+//init syscall. There is no global file system lock: inodes,
+//directories and the free map synchronize themselves, and an fd
+//and its file position belong to a single process.
 void syscall_init (void) {
-  lock_init(&file_lock);
   intr_register_int (0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
@@ -139,9 +141,7 @@ pid_t exec(const char* cmd_line){
   char* kcmd_line = copy_in_string(cmd_line);
 
 
-  lock_acquire (&file_lock);
   pid_t pid = process_execute(kcmd_line);
-  lock_release (&file_lock);
 
   palloc_free_page(kcmd_line);
 
@@ -158,7 +158,6 @@ int wait(pid_t pid){
 /* Create system call. */
 bool create (const char *ufile, unsigned initial_size)
 {
-  lock_acquire(&file_lock);
   //copying user string to kernel space
   char *kfile = copy_in_string (ufile);
   //check if kfile is valid
@@ -172,18 +171,15 @@ bool create (const char *ufile, unsigned initial_size)
   bool ok = filesys_create (kfile, initial_size, FILE_INODE);
   //freeing resources from kfile
   palloc_free_page((void*)kfile);
-  lock_release(&file_lock);
   return ok;
 }
 
 /*Deletes the file called file. Returns true if successful, 
 false otherwise.*/
 bool remove (const char *file){
-  lock_acquire(&file_lock);
   char* kfile = copy_in_string(file);
   bool ok = filesys_remove(kfile);
   palloc_free_page(kfile);
-  lock_release(&file_lock);
   return ok;
 }
 
@@ -205,13 +201,11 @@ int open(const char *file){
     return -1;
   }
 
-  lock_acquire(&file_lock);
   struct inode* inode = filesys_open(kfile);
   if(inode == NULL){
     //printf("syscall.c, inode == NULL.\n");
     free(file_des);
     palloc_free_page(kfile);
-    lock_release(&file_lock);
     return -1;
   }
   if(inode_get_type(inode) == DIR_INODE){
@@ -227,12 +221,10 @@ int open(const char *file){
     inode_remove(inode);
     inode_close(inode);
     palloc_free_page(kfile);
-    lock_release(&file_lock);
     //printf("syscall.c, both are NULL.\n");
     return -1;
   }
   int fd = file_des->fd;
-  lock_release(&file_lock);
   palloc_free_page(kfile);
   return fd;
 }
@@ -241,79 +233,63 @@ int open(const char *file){
 int filesize (int fd){
   struct file* f = get_file_by_fd(fd);
 
-  //lock needed b/c other syscall that may change the length
-  lock_acquire(&file_lock);
   int length = file_length(f);
-  lock_release(&file_lock);
 
   return length;
 }
 
+/* Returns true if all SIZE bytes of user memory at UADDR are
+   mapped in the current process, and also writable if WRITABLE
+   is true.  There is no paging, so such pages stay resident (in
+   effect pinned) until the process exits, and the kernel can copy
+   to and from them directly for the rest of the system call. */
+static bool
+user_range_ok (const void *uaddr, size_t size, bool writable)
+{
+  uint32_t *pd = thread_current ()->pagedir;
+  uintptr_t start = (uintptr_t) uaddr;
+  uintptr_t end = start + size;
+  uintptr_t page;
+
+  if (end < start || !is_user_vaddr ((void *) (end - 1)))
+    return false;
+  for (page = (uintptr_t) pg_round_down (uaddr); page < end; page += PGSIZE)
+    if (pagedir_get_page (pd, (void *) page) == NULL
+        || (writable && !pagedir_is_writable (pd, (void *) page)))
+      return false;
+  return true;
+}
+
 /* Read system call. similar to write system call*/
 static int read (int fd, const void *buffer, unsigned size)
 {
-   //DELETE
-  //printf("read\n");
   //just return if size is 0
   if (size == 0) {
     return 0;
   }
 
-  //edge case handling: if size is 0, 
-  //or buffer is NULL or not a user virtual address
-  if(buffer == NULL || !is_user_vaddr(buffer) || !is_user_vaddr((void*)((char*)buffer + size))) {
+  //the whole buffer is checked once up front, then filled in place:
+  //file data goes straight from the buffer cache into it
+  if (buffer == NULL || !user_range_ok (buffer, size, true)) {
     exit(-1);
   }
 
+  if (fd == STDIN_FILENO) {
+    //for reading from the console
+    //input_getc from devices/input.h is helpful
+    for (unsigned i = 0; i < size; i++) {
+      ((uint8_t *) buffer)[i] = input_getc();
+    }
+    return size;
+  }
+
   // Retrieve the file from the file descriptor
   struct file* f = get_file_by_fd(fd);
   if (f == NULL) {
     exit(-1);
   }
 
-
-  unsigned bytes_read = 0;
-  unsigned size_to_read = size;
-  while (size_to_read > 0) {
-    char *kbuffer = (char*)palloc_get_page(0);
-    if (kbuffer == NULL) {
-      return bytes_read;
-    }
-
-    unsigned read_amount = (size - bytes_read < PGSIZE) ? (size - bytes_read) : PGSIZE;
-    
-    unsigned retval;
-    if (fd == STDIN_FILENO) {
-      //for reading from the console
-      //input_getc from devices/input.h is helpful
-      for (unsigned i = 0; i < read_amount; i++) {
-        kbuffer[i] = input_getc();
-      }
-      retval = read_amount;
-    } else {
-      lock_acquire(&file_lock);
-      retval = file_read(f, kbuffer, read_amount);
-      lock_release(&file_lock);
-    }
-
-    //copy data from kernel buffer to user buffer
-    for (unsigned i = 0; i < retval; i++){
-        if (!put_user ((uint8_t *)buffer + bytes_read + i, kbuffer[i]))
-          {
-            //if reading to user space fails, terminate the process
-            palloc_free_page (kbuffer);
-            exit (-1);
-          }
-    }
-
-    bytes_read += retval;
-    size_to_read -= retval;
-    palloc_free_page(kbuffer);
-
-    if (retval < read_amount) {
-      break; // EOF or error reading from file
-    }
-  }
+  int bytes_read = file_read(f, (void *) buffer, size);
 
   return bytes_read;
 }
@@ -336,48 +312,18 @@ write (int handle, const void *usrc_, unsigned size) {
         exit(-1);
     }
 
-    //terminate the process if `usrc_` is NULL
-    if (usrc_ == NULL) {
+    //terminate the process if `usrc_` is NULL or any of the
+    //buffer is not mapped; after that it is read in place
+    if (usrc_ == NULL || !user_range_ok (usrc_, size, false)) {
         exit(-1);
     }
 
-    //check validity of entire buffer range
-    for (unsigned i = 0; i < size; i++) {
-        void *current_addr = (void *) ((char *) usrc_ + i);
-        if (!is_user_vaddr(current_addr)) {
-            exit(-1);
-        }
+    if (handle == STDOUT_FILENO) {
+        putbuf(usrc_, size);
+        return size;
     }
 
-    unsigned bytes_written = 0;
-
-    while (bytes_written < size) {
-        char *kbuffer = (char*) palloc_get_page(0);
-        if (kbuffer == NULL) {
-            return bytes_written;
-        }
-
-        unsigned write_amount = (PGSIZE > size - bytes_written) ? size - bytes_written : PGSIZE;
-        copy_in(kbuffer, (uint8_t*) usrc_ + bytes_written, write_amount);
-        unsigned retval;
-        if (handle == STDOUT_FILENO) {
-            putbuf(kbuffer, write_amount);
-            retval = write_amount;
-        } else {
-            lock_acquire(&file_lock);
-            //printf("syscall.c, about to do file_write.\n");
-            retval = file_write(f, kbuffer, write_amount);
-            //printf("syscall.c, after file_write.\n");
-            lock_release(&file_lock);
-        }
-        bytes_written += retval;
-        palloc_free_page(kbuffer);
-
-        //break if actual wrriten amount is less than theoretical amount
-        if (retval < write_amount) {
-            break;
-        }
-    }
+    int bytes_written = file_write(f, usrc_, size);
 
     return bytes_written;
 }
@@ -388,9 +334,7 @@ void seek (int fd, unsigned position){
   struct file* f = get_file_by_fd(fd);
   //edge case handling if f is NULL
   if(f != NULL){
-    lock_acquire(&file_lock);
     file_seek(f,position);
-    lock_release(&file_lock);
   }
 }
 
@@ -399,11 +343,8 @@ void seek (int fd, unsigned position){
 unsigned tell (int fd){
   struct file* f = get_file_by_fd(fd);
 
-  //synchronization lock due to potential changes in file
-  lock_acquire(&file_lock);
-    //get pos via file_tell
-    off_t pos = file_tell(f);
-  lock_release(&file_lock);
+  //get pos via file_tell
+  off_t pos = file_tell(f);
 
   return pos;
 }
@@ -418,17 +359,12 @@ void close (int fd){
   //edge case handling: f not found given fd
   if(f!=NULL){
     //closing the file if f exists
-    lock_acquire(&file_lock);
     file_close(f);
-    lock_release(&file_lock);
   }
   if(dir != NULL){
-    lock_acquire(&file_lock);
     dir_close(dir);
-    lock_release(&file_lock);
   }
 
-  lock_acquire(&file_lock);
   
   //now update the fd_list by removing this closed f
   struct file_descriptor* file_des;
@@ -444,7 +380,6 @@ void close (int fd){
       break;
     }
   }
-  lock_release(&file_lock);
 }
 
 
@@ -508,6 +443,147 @@ int inumber (int fd){
   return inode_get_inumber (file->inode);
 }
 
+/* Reserves contiguous disk space for LENGTH bytes of the file
+   open as fd starting at OFFSET, extending the file if needed,
+   so that writing them later does not allocate sector by sector.
+   The space is not zeroed: unwritten bytes still read as zeros. */
+bool fallocate (int fd, unsigned offset, unsigned length){
+  struct file* file = get_file_by_fd(fd);
+  if(file == NULL){return false;}
+  bool ok = file_allocate(file, offset, length);
+  return ok;
+}
+
+/* Reads up to CNT entries of the directory open as fd into the
+   user array ENTRIES, with each entry's inode number, type and
+   length, so that listing a directory takes a few calls rather
+   than several per entry.  Returns the number of entries read,
+   0 at the end of the directory, or -1 if fd is not a directory.
+   At most a page of entries is returned per call.  readdir() on
+   the same fd continues from where this stops, and vice versa. */
+int getdents (int fd, struct dirent *entries, unsigned cnt){
+  struct dir* dir = get_dir_by_fd(fd);
+  if(dir == NULL){return -1;}
+  if(cnt > PGSIZE / sizeof *entries){
+    cnt = PGSIZE / sizeof *entries;
+  }
+
+  struct dirent *kentries = palloc_get_page(0);
+  if(kentries == NULL){return -1;}
+
+  //the directory code fills in each entry's type and length
+  //under the directory's lock
+  unsigned filled = dir_readdir_entries(dir, kentries, cnt);
+
+  bool ok = copy_out(entries, kentries, filled * sizeof *entries);
+  palloc_free_page(kentries);
+  if(!ok){exit(-1);}
+  return filled;
+}
+
+/* Reads SIZE bytes from the file open as fd, starting at OFFSET
+   rather than at its current position, which is left alone.
+   Threads and processes sharing a file can then read records
+   without a seek in between that another one could interleave
+   with.  Returns the number of bytes read, or -1 for the
+   console, which has no offsets, or an OFFSET too large for a
+   file. */
+int pread (int fd, void *buffer, unsigned size, unsigned offset){
+  if(fd == STDIN_FILENO || fd == STDOUT_FILENO){return -1;}
+  struct file* f = get_file_by_fd(fd);
+  if(f == NULL){exit(-1);}
+  if((off_t) offset < 0){return -1;}
+  if(size == 0){return 0;}
+  if(buffer == NULL || !user_range_ok(buffer, size, true)){exit(-1);}
+  return file_read_at(f, buffer, size, offset);
+}
+
+/* Writes SIZE bytes to the file open as fd at OFFSET, the way
+   pread() reads.  The file grows if OFFSET + SIZE is past its
+   end.  Returns the number of bytes written, or -1 for the
+   console. */
+int pwrite (int fd, const void *buffer, unsigned size, unsigned offset){
+  if(fd == STDIN_FILENO || fd == STDOUT_FILENO){return -1;}
+  struct file* f = get_file_by_fd(fd);
+  if(f == NULL){exit(-1);}
+  if((off_t) offset < 0){return -1;}
+  if(size == 0){return 0;}
+  if(buffer == NULL || !user_range_ok(buffer, size, false)){exit(-1);}
+  return file_write_at(f, buffer, size, offset);
+}
+
+/* Copies the IOVCNT buffers described by the user array IOV into
+   KIOV.  Returns false if IOVCNT is out of range. */
+static bool copy_in_iovec (struct iovec *kiov, const struct iovec *iov,
+                           int iovcnt){
+  if(iovcnt < 0 || iovcnt > IOV_MAX){return false;}
+  if(iov == NULL && iovcnt > 0){exit(-1);}
+  copy_in(kiov, iov, iovcnt * sizeof *kiov);
+  return true;
+}
+
+/* Reads from fd into the IOVCNT buffers in IOV in order, as one
+   read per buffer would, but with a single syscall.  Stops at the
+   first buffer that is not filled completely (end of file).
+   Returns the total number of bytes read, or -1 if IOVCNT is
+   negative or larger than IOV_MAX. */
+int readv (int fd, const struct iovec *iov, int iovcnt){
+  struct iovec kiov[IOV_MAX];
+  if(!copy_in_iovec(kiov, iov, iovcnt)){return -1;}
+
+  int total = 0;
+  for(int i = 0; i < iovcnt; i++){
+    int n = read(fd, kiov[i].iov_base, kiov[i].iov_len);
+    total += n;
+    if((unsigned) n < kiov[i].iov_len){break;}
+  }
+  return total;
+}
+
+/* Writes the IOVCNT buffers in IOV to fd in order, as one write
+   per buffer would, but with a single syscall.  Stops at the
+   first buffer that is not written completely.  Returns the
+   total number of bytes written, or -1 if IOVCNT is negative or
+   larger than IOV_MAX. */
+int writev (int fd, const struct iovec *iov, int iovcnt){
+  struct iovec kiov[IOV_MAX];
+  if(!copy_in_iovec(kiov, iov, iovcnt)){return -1;}
+
+  int total = 0;
+  for(int i = 0; i < iovcnt; i++){
+    int n = write(fd, kiov[i].iov_base, kiov[i].iov_len);
+    total += n;
+    if((unsigned) n < kiov[i].iov_len){break;}
+  }
+  return total;
+}
+
+/* Copies up to SIZE bytes from the file open as in_fd, at its
+   position, to the file open as out_fd, at its position, inside
+   the kernel with file_copy(), so copying a file takes a few
+   syscalls and no user buffer.  Advances both positions.  Returns
+   the number of bytes copied (0 at the end of in_fd), or -1 if
+   either fd is the console or a directory, or if both are the same
+   file and the two ranges could overlap. */
+int copy_file_range (int in_fd, int out_fd, unsigned size){
+  struct file* in = get_file_by_fd(in_fd);
+  struct file* out = get_file_by_fd(out_fd);
+  if(in == NULL || out == NULL){return -1;}
+
+  //only what is left of in_fd can be copied
+  off_t in_pos = file_tell(in), out_pos = file_tell(out);
+  off_t left = file_length(in) - in_pos;
+  if(left <= 0){return 0;}
+  if(size > (unsigned) left){size = left;}
+
+  //a forward copy within one file would read back what it wrote
+  if(file_get_inode(in) == file_get_inode(out)
+     && in_pos < (int64_t) out_pos + size && out_pos < in_pos + (off_t) size){
+    return -1;
+  }
+  return file_copy(out, in, size);
+}
+
 static void
 syscall_handler (struct intr_frame *f UNUSED) 
 {
@@ -529,7 +605,7 @@ syscall_handler (struct intr_frame *f UNUSED)
   //copy syscall number and arguments from user space to kernel space
   unsigned call_nr; //syscall number
   copy_in (&call_nr, f->esp, sizeof call_nr); //get the system call number and store in call_nr
-  int args[3]; // It's 3 because that's the max number of arguments in all syscalls.
+  int args[4]; // It's 4 because that's the max number of arguments in all syscalls (pread and pwrite).
   memset (args, 0, sizeof args);
 
 
@@ -630,6 +706,41 @@ syscall_handler (struct intr_frame *f UNUSED)
       copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
       f->eax = inumber((int)args[0]);
       break;
+    case SYS_FALLOCATE:
+      arg_cnt = 3;
+      copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
+      f->eax = fallocate((int)args[0], (unsigned)args[1], (unsigned)args[2]);
+      break;
+    case SYS_GETDENTS:
+      arg_cnt = 3;
+      copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
+      f->eax = getdents((int)args[0], (struct dirent*)args[1], (unsigned)args[2]);
+      break;
+    case SYS_PREAD:
+      arg_cnt = 4;
+      copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
+      f->eax = pread((int)args[0], (void*)args[1], (unsigned)args[2], (unsigned)args[3]);
+      break;
+    case SYS_PWRITE:
+      arg_cnt = 4;
+      copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
+      f->eax = pwrite((int)args[0], (const void*)args[1], (unsigned)args[2], (unsigned)args[3]);
+      break;
+    case SYS_READV:
+      arg_cnt = 3;
+      copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
+      f->eax = readv((int)args[0], (const struct iovec*)args[1], (int)args[2]);
+      break;
+    case SYS_WRITEV:
+      arg_cnt = 3;
+      copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
+      f->eax = writev((int)args[0], (const struct iovec*)args[1], (int)args[2]);
+      break;
+    case SYS_COPY_FILE_RANGE:
+      arg_cnt = 3;
+      copy_in (args, (uint32_t *) f->esp + 1, sizeof *args * arg_cnt);
+      f->eax = copy_file_range((int)args[0], (int)args[1], (unsigned)args[2]);
+      break;
     //error handling for unknown syscall
     default: 
       exit(-1);
@@ -650,6 +761,20 @@ static void copy_in (void *dst_, const void *usrc_, size_t size) {
     }
 }
 
+/* Copies SIZE bytes from kernel address SRC to user address UDST.
+   Returns false if any of the user accesses are invalid, in which case
+   the caller should free its resources and exit(-1). */
+static bool copy_out (void *udst_, const void *src_, size_t size) {
+  uint8_t *udst = udst_;
+  const uint8_t *src = src_;
+
+  for (; size > 0; size--, udst++, src++)
+    if (udst >= (uint8_t *) PHYS_BASE || !put_user (udst, *src)){
+      return false;
+    }
+  return true;
+}
+
 /* Creates a copy of user string US in kernel memory and returns it as a
    page that must be **freed with palloc_free_page()**.  Truncates the string
    at PGSIZE bytes in size.  Call thread_exit() if any of the user accesses
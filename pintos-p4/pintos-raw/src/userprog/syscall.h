@@ -7,6 +7,8 @@
 #include <string.h>
 #include <stdlib.h>
 #include <syscall-nr.h>
+#include <dirent.h>
+#include <uio.h>
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -15,9 +17,6 @@
 #include "filesys/filesys.h"
 #include "devices/input.h"
 
-//a global lock for file related syscall
-static struct lock file_lock;
-
 //since pid and tid is 1-1 mapping, let pid = tid
 typedef tid_t pid_t;
 
@@ -51,6 +50,13 @@ int mkdir (const char *dir);
 bool readdir (int fd, char *name);
 bool isdir (int fd);
 int inumber (int fd);
+bool fallocate (int fd, unsigned offset, unsigned length);
+int getdents (int fd, struct dirent *entries, unsigned cnt);
+int pread (int fd, void *buffer, unsigned size, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned size, unsigned offset);
+int readv (int fd, const struct iovec *iov, int iovcnt);
+int writev (int fd, const struct iovec *iov, int iovcnt);
+int copy_file_range (int in_fd, int out_fd, unsigned size);
 
 
 #endif /* userprog/syscall.h */